@@ -26,6 +26,12 @@ along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
 #include "Core/Emulator.h"
 #include "Core/Fonts.h"
 #include "Core/Instructions.h"
+#include "Core/Jit.h"
+#include "Core/Fusion.h"
+#include "Core/GfxKernels.h"
+#include "Core/Headless.h"
+#include "Core/Pacer.h"
+#include "Core/TripleBuffer.h"
 
 
 
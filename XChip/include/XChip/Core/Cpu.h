@@ -22,6 +22,7 @@ along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
 
 #ifndef XCHIP_CORE_CPU_H_
 #define XCHIP_CORE_CPU_H_
+#include <cstddef>
 #include <Utix/Ints.h>
  
 
@@ -29,28 +30,88 @@ namespace xchip {
 class iRender;
 class iInput;
 class iSound;
+class CpuManager;
+struct Cpu;
 
 
 
-struct Cpu
+// an instruction decoded once and cached by its memory address.
+// handler is the final handler ( subtables already resolved )
+// or nullptr when the entry is not decoded yet. N is opcode & 0xf.
+// fusion caches the superinstruction starting here, it depends
+// on the next opcode too.
+struct DecodedInstr
 {
-	uint8_t* memory;
-	uint8_t* registers;
-	size_t*  stack;
-	uint32_t* gfx;
+	void(*handler)(CpuManager&);
+	uint16_t opcode;
+	uint16_t nnn;
+	uint8_t x;
+	uint8_t y;
+	uint8_t nn;
+	uint8_t fusion;
+};
+
+
+
+// a straight-line run of decoded instructions, translated once and
+// executed back to back. ends at the first instruction which may
+// change pc, write memory or stop the emulator. next[] caches the
+// blocks executed after this one. native is set when the block
+// gets hot and is compiled by a JitArena.
+struct InstrBlock
+{
+	DecodedInstr* code;
+	InstrBlock* next[2];
+	void(*native)(CpuManager&, Cpu&);
+	uint32_t hits;
+	uint32_t end; // up to 0x10000
+	uint16_t begin;
+	uint16_t size;
+	bool valid;
+};
 
-	iRender* render;
-	iInput* input;
-	iSound* sound;
 
-	size_t sp;
-	size_t pc;
-	size_t I;
 
+// the whole machine state, no pointer chasing from the handlers.
+// the first cache line holds everything touched by most
+// instructions, the address space comes after the cold fields.
+// pc and I are 32 bits, 16 bits stores to them were slower.
+// the opcode and its operands are laid out as in DecodedInstr,
+// they are copied from the cache entry as one 8 bytes word.
+struct alignas(64) Cpu
+{
+	uint8_t registers[16];
+	uint32_t pc;
+	uint32_t I;
 	uint32_t flags;
 	uint16_t opcode;
+	uint16_t nnn;
+	uint8_t x;
+	uint8_t y;
+	uint8_t nn;
+	uint8_t fusion; // unused, copied with the operands
+	uint8_t sp;
 	uint8_t delayTimer;
 	uint8_t soundTimer;
+	uint16_t stack[16];
+
+	uint32_t* gfx;   // plane expanded for iRender, one uint32 per pixel
+	uint64_t* plane; // 1bpp screen, 2 words per row, pixel 0 is the msb
+	iRender* render;
+	iInput* input;
+	iSound* sound;
+
+	// addresses are 16 bits, pc and I are always masked. the guard
+	// bytes after the address space mirror its first 64 bytes, the
+	// accesses which start in it and run past 0xFFFF ( at most 32, a 
+	// 16x16 sprite ) wrap around without a bounds check.
+	alignas(64) uint8_t memory[0x10000 + 64];
+
+	enum Address : uint32_t
+	{
+		ADDRESS_MASK = 0xFFFF,
+		ADDRESS_SPACE = 0x10000
+	};
 	
 	enum Flags : uint32_t 
 	{ 
@@ -61,10 +122,18 @@ struct Cpu
 		EXTENDED_MODE = 0x10,
 		BAD_RENDER = 0x20,
 		BAD_INPUT = 0x40,
-		BAD_SOUND = 0x80
+		BAD_SOUND = 0x80,
+		GFX_CHANGED = 0x100, // the screen was written since the flag was unset
+		WAIT_KEY = 0x200     // FX0A waited for a key since the flag was unset
 	};
 };
 
+static_assert(offsetof(Cpu, delayTimer) < 64, "Cpu hot state is over a cache line");
+static_assert(offsetof(Cpu, fusion) - offsetof(Cpu, opcode) == offsetof(DecodedInstr, fusion) - offsetof(DecodedInstr, opcode)
+              && offsetof(Cpu, x) - offsetof(Cpu, opcode) == offsetof(DecodedInstr, x) - offsetof(DecodedInstr, opcode)
+              && offsetof(Cpu, fusion) - offsetof(Cpu, opcode) == 7,
+              "Cpu operands are not laid out as in DecodedInstr");
+
 
 
 
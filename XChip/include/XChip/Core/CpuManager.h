@@ -21,11 +21,13 @@ along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
 #ifndef XCHIP_CORE_MANAGER_H_
 #define XCHIP_CORE_MANAGER_H_
 
+#include <cstring>
 #include <Utix/Alloc.h>
 #include <Utix/Vector2.h>
 
 #include "Cpu.h"
 #include "Fonts.h"
+#include "GfxKernels.h"
 
 
 
@@ -46,6 +48,10 @@ public:
 	uint8_t GetSoundTimer() const;
 	uint16_t GetOpcode() const;
 	uint16_t GetOpcode(const uint16_t mask) const;
+	uint8_t GetX() const;
+	uint8_t GetY() const;
+	uint8_t GetNN() const;
+	uint16_t GetNNN() const;
 	uint32_t GetFlags() const;
 	uint32_t GetFlags(const uint32_t flags) const;
 	size_t GetIndexRegister() const;
@@ -63,15 +69,22 @@ public:
 	const iSound* GetSound() const;
 	const uint8_t* GetMemory() const;
 	const uint8_t* GetRegisters() const;
-	const size_t* GetStack() const;
+	const uint16_t* GetStack() const;
 	const uint32_t* GetGfx() const;
+	const uint64_t* GetPlane() const;
+	const uint64_t* GetPlaneRow(const int y) const;
 	const Cpu& GetCpu() const;
 	const uint8_t& GetMemory(const size_t offset) const;
 	const uint8_t& GetRegisters(const size_t offset) const;
-	const size_t& GetStack(const size_t offset) const;
+	const uint16_t& GetStack(const size_t offset) const;
 	const uint32_t& GetGfx(const size_t offset) const;
 	const uint32_t& GetGfx(const utix::Vec2i& point) const;
 	const uint32_t& GetGfx(const int x, const int y) const;
+	const DecodedInstr& GetInstrCache(const size_t offset) const;
+	const InstrBlock* GetBlock(const size_t offset) const;
+	const uint64_t* GetDirtyPages() const;
+	uint64_t GetDirtyRows() const;
+	bool IsMemoryDirty(const size_t offset, const size_t size) const;
 
 
 	iRender* GetRender();
@@ -79,38 +92,49 @@ public:
 	iSound* GetSound();
 	uint8_t* GetMemory();
 	uint8_t* GetRegisters();
-	size_t* GetStack();
+	uint16_t* GetStack();
 	uint32_t* GetGfx();
+	uint64_t* GetPlane();
+	uint64_t* GetPlaneRow(const int y);
 	Cpu& GetCpu();
 	uint8_t& GetMemory(const size_t offset);
 	uint8_t& GetRegisters(const size_t offset);
-	size_t& GetStack(const size_t offset);
+	uint16_t& GetStack(const size_t offset);
 	uint32_t& GetGfx(const size_t offset);
 	uint32_t& GetGfx(const utix::Vec2i& point);
 	uint32_t& GetGfx(const int x, const int y);
+	DecodedInstr& GetInstrCache(const size_t offset);
+	InstrBlock* GetBlock(const size_t offset);
+	InstrBlock* GetResumeBlock();
+	InstrBlock* NewBlock(const size_t offset, const size_t size);
 	
 
 	void FetchOpcode();
+	void SetLazyFlag(const uint8_t op, const uint8_t vx, const uint8_t vy);
+	void ResolveFlag() const;
+	uint32_t NextRandom();
 	bool SetMemory(const size_t size);
-	bool SetRegisters(const size_t size);
-	bool SetStack(const size_t size);
 	bool SetGfxRes(const utix::Vec2i& res);
 	bool SetGfxRes(const int w, const int h);
-	bool ResizeMemory(const size_t size);
-	bool ResizeRegisters(const size_t size);
-	bool ResizeStack(const size_t size);
+	bool SetBlockCache(const size_t blocks, const size_t instrs);
+	void SetResumeBlock(InstrBlock* block);
+	bool SetDirtyTracking();
+	void MarkDirtyRows(const int y, const int count);
 	void SetFlags(const uint32_t flags);
 	void UnsetFlags(const uint32_t flags);
 	void CleanFlags();
 	void SetDelayTimer(const uint8_t val);
 	void SetSoundTimer(const uint8_t val);
 	void SetOpcode(const uint16_t val);
+	void SetInstr(const DecodedInstr& instr);
+	void SetRandSeed(const uint32_t seed);
 	void SetIndexRegister(const size_t index);
 	void SetPC(const size_t offset);
 	void SetSP(const size_t offset);
 	void LoadDefaultFont();
 	void LoadHiResFont();
 	bool LoadRom(const char* file, const size_t at);
+	bool LoadRom(const uint8_t* data, const size_t size, const size_t at);
 	void SetRender(iRender* render);
 	void SetInput(iInput* input);
 	void SetSound(iSound* sound);
@@ -124,13 +148,48 @@ public:
 	void CleanRegisters();
 	void CleanStack();
 	void CleanGfx();
+	uint64_t ExpandGfx();
+	void CleanInstrCache();
+	void CleanBlockCache();
+	void CleanDirtyPages();
+	void InvalidateInstrCache(const size_t offset, const size_t size);
 
 	static constexpr size_t GetDefaultFontIndex();
 	static constexpr size_t GetHiResFontIndex();
+	static constexpr utix::Vec2i GetMaxGfxRes();
+	static constexpr size_t GetPageSize();
 
 private:
-	Cpu m_cpu;
+	void InvalidateBlocks(const size_t offset, const size_t size);
+	void MirrorGuard(const size_t offset, const size_t size);
+	void MarkDirtyPages(const size_t offset, const size_t size);
+	void ComputeFlag() const;
+	void DropFlag();
+
+	DecodedInstr* m_instrCache = nullptr;
+	InstrBlock* m_blocks = nullptr;
+	DecodedInstr* m_blocksCode = nullptr;
+	uint16_t* m_blocksMap = nullptr;
+	// how many valid blocks cover each memory byte
+	uint8_t* m_codeMap = nullptr;
+	size_t m_blocksUsed = 0;
+	size_t m_blocksCodeUsed = 0;
+	// the block a partial run stopped in, ExecuteBlocks goes on from pc
+	InstrBlock* m_resumeBlock = nullptr;
+	// a bit per memory page written since the last CleanDirtyPages
+	uint64_t* m_dirtyPages = nullptr;
+	// a bit per screen row written since the last ExpandGfx
+	uint64_t m_dirtyRows = 0;
+	uint32_t m_randState = 0x2545F491;
 	utix::Vec2i m_gfxRes = {0, 0};
+#if defined(XCHIP_LAZY_VF)
+	// the 8XYx ( 4 - E ) and operands of the VF not computed yet, 0 if none
+	mutable uint8_t m_flagOp = 0;
+	uint8_t m_flagVx = 0;
+	uint8_t m_flagVy = 0;
+#endif
+	// last, the members above stay next to the Cpu hot fields
+	Cpu m_cpu;
 };
 
 
@@ -143,14 +202,18 @@ inline uint8_t CpuManager::GetDelayTimer() const { return m_cpu.delayTimer; }
 inline uint8_t CpuManager::GetSoundTimer() const { return m_cpu.soundTimer; }
 inline uint16_t CpuManager::GetOpcode() const { return m_cpu.opcode; }
 inline uint16_t CpuManager::GetOpcode(const uint16_t mask) const { return m_cpu.opcode & mask; }
+inline uint8_t CpuManager::GetX() const { return m_cpu.x; }
+inline uint8_t CpuManager::GetY() const { return m_cpu.y; }
+inline uint8_t CpuManager::GetNN() const { return m_cpu.nn; }
+inline uint16_t CpuManager::GetNNN() const { return m_cpu.nnn; }
 inline uint32_t CpuManager::GetFlags() const { return m_cpu.flags; }
 inline uint32_t CpuManager::GetFlags(const uint32_t flags) const { return m_cpu.flags & flags; }
 inline size_t CpuManager::GetIndexRegister() const { return m_cpu.I; }
 inline size_t CpuManager::GetPC() const { return m_cpu.pc; }
 inline size_t CpuManager::GetSP() const { return m_cpu.sp; }
-inline size_t CpuManager::GetMemorySize() const { return utix::arr_size(m_cpu.memory); }
-inline size_t CpuManager::GetRegistersSize() const { return utix::arr_size(m_cpu.registers); }
-inline size_t CpuManager::GetStackSize() const { return utix::arr_size(m_cpu.stack); }
+inline size_t CpuManager::GetMemorySize() const { return Cpu::ADDRESS_SPACE; }
+inline size_t CpuManager::GetRegistersSize() const { return sizeof(m_cpu.registers); }
+inline size_t CpuManager::GetStackSize() const { return sizeof(m_cpu.stack) / sizeof(m_cpu.stack[0]); }
 inline size_t CpuManager::GetGfxSize() const { return utix::arr_size(m_cpu.gfx); }
 inline const utix::Vec2i& CpuManager::GetGfxRes() const { return m_gfxRes; }
 
@@ -158,27 +221,30 @@ inline const iRender* CpuManager::GetRender() const { return m_cpu.render; }
 inline const iInput* CpuManager::GetInput() const { return m_cpu.input; }
 inline const iSound* CpuManager::GetSound() const { return m_cpu.sound; }
 inline const uint8_t* CpuManager::GetMemory() const { return m_cpu.memory; }
-inline const uint8_t* CpuManager::GetRegisters() const { return m_cpu.registers; }
-inline const size_t* CpuManager::GetStack() const { return m_cpu.stack; }
+inline const uint8_t* CpuManager::GetRegisters() const { ResolveFlag(); return m_cpu.registers; }
+inline const uint16_t* CpuManager::GetStack() const { return m_cpu.stack; }
 inline const uint32_t* CpuManager::GetGfx() const { return m_cpu.gfx; }
-inline const Cpu& CpuManager::GetCpu() const { return m_cpu; }
+inline const uint64_t* CpuManager::GetPlane() const { return m_cpu.plane; }
+inline const Cpu& CpuManager::GetCpu() const { ResolveFlag(); return m_cpu; }
 
 
 
 inline const uint8_t& CpuManager::GetMemory(const size_t offset) const 
 { 
-	ASSERT_MSG(GetMemorySize() > offset, "memory overflow"); 
+	ASSERT_MSG(sizeof(m_cpu.memory) > offset, "memory overflow"); 
 	return m_cpu.memory[offset]; 
 }
 
 inline const uint8_t& CpuManager::GetRegisters(const size_t offset) const
 {
 	ASSERT_MSG(GetRegistersSize() > offset, "registers overflow"); 
+	if (offset == 0xF)
+		ResolveFlag();
 	return m_cpu.registers[offset]; 
 }
 
 
-inline const size_t& CpuManager::GetStack(const size_t offset) const 
+inline const uint16_t& CpuManager::GetStack(const size_t offset) const 
 { 
 	ASSERT_MSG(GetStackSize() > offset, "stack overflow");
 	return m_cpu.stack[offset]; 
@@ -207,6 +273,47 @@ inline const uint32_t& CpuManager::GetGfx(const int x, const int y) const
 	return m_cpu.gfx[ ( m_gfxRes.x * y ) + x]; 
 }
 
+inline const uint64_t* CpuManager::GetPlaneRow(const int y) const
+{
+	ASSERT_MSG(m_gfxRes.y > y, "plane overflow");
+	return m_cpu.plane + (y * 2);
+}
+
+
+inline const DecodedInstr& CpuManager::GetInstrCache(const size_t offset) const
+{
+	ASSERT_MSG(GetMemorySize() > offset, "instruction cache overflow");
+	return m_instrCache[offset];
+}
+
+
+inline const uint64_t* CpuManager::GetDirtyPages() const { return m_dirtyPages; }
+inline uint64_t CpuManager::GetDirtyRows() const { return m_dirtyRows; }
+
+
+inline bool CpuManager::IsMemoryDirty(const size_t offset, const size_t size) const
+{
+	ASSERT_MSG(m_dirtyPages != nullptr, "null dirty pages");
+	const size_t last = (offset + size - 1) / GetPageSize();
+	for (size_t page = offset / GetPageSize(); size && page <= last; ++page)
+	{
+		if (m_dirtyPages[page / 64] & (uint64_t(1) << (page % 64)))
+			return true;
+	}
+
+	return false;
+}
+
+
+
+inline const InstrBlock* CpuManager::GetBlock(const size_t offset) const
+{
+	ASSERT_MSG(m_blocksMap != nullptr, "null block cache");
+	ASSERT_MSG(GetMemorySize() > offset, "block cache overflow");
+	const auto index = m_blocksMap[offset];
+	return index ? &m_blocks[index - 1] : nullptr;
+}
+
 
 
 
@@ -216,15 +323,16 @@ inline iRender* CpuManager::GetRender() { return m_cpu.render; }
 inline iInput* CpuManager::GetInput() { return m_cpu.input; }
 inline iSound* CpuManager::GetSound() { return m_cpu.sound; }
 inline uint8_t* CpuManager::GetMemory() { return m_cpu.memory; }
-inline uint8_t* CpuManager::GetRegisters() { return m_cpu.registers; }
-inline size_t* CpuManager::GetStack() { return m_cpu.stack; }
+inline uint8_t* CpuManager::GetRegisters() { ResolveFlag(); return m_cpu.registers; }
+inline uint16_t* CpuManager::GetStack() { return m_cpu.stack; }
 inline uint32_t* CpuManager::GetGfx() { return m_cpu.gfx; }
-inline Cpu& CpuManager::GetCpu() { return m_cpu; }
+inline uint64_t* CpuManager::GetPlane() { return m_cpu.plane; }
+inline Cpu& CpuManager::GetCpu() { ResolveFlag(); return m_cpu; }
 
 
 inline uint8_t& CpuManager::GetMemory(const size_t offset) 
 { 
-	ASSERT_MSG(GetMemorySize() > offset, "memory overflow"); 
+	ASSERT_MSG(sizeof(m_cpu.memory) > offset, "memory overflow"); 
 	return m_cpu.memory[offset]; 
 }
 
@@ -232,10 +340,12 @@ inline uint8_t& CpuManager::GetMemory(const size_t offset)
 inline uint8_t& CpuManager::GetRegisters(const size_t offset) 
 { 
 	ASSERT_MSG(GetRegistersSize() > offset, "registers overflow"); 
+	if (offset == 0xF)
+		ResolveFlag();
 	return m_cpu.registers[offset]; 
 }
  
-inline size_t& CpuManager::GetStack(const size_t offset)  
+inline uint16_t& CpuManager::GetStack(const size_t offset)  
 { 
 	ASSERT_MSG(GetStackSize() > offset, "stack overflow"); 
 	return m_cpu.stack[offset]; 
@@ -262,11 +372,78 @@ inline uint32_t& CpuManager::GetGfx(const int x, const int y)
 	return m_cpu.gfx[ ( m_gfxRes.x * y ) + x]; 
 }
 
+inline uint64_t* CpuManager::GetPlaneRow(const int y)
+{
+	ASSERT_MSG(m_gfxRes.y > y, "plane overflow");
+	return m_cpu.plane + (y * 2);
+}
+
+
+inline DecodedInstr& CpuManager::GetInstrCache(const size_t offset)
+{
+	ASSERT_MSG(GetMemorySize() > offset, "instruction cache overflow");
+	return m_instrCache[offset];
+}
+
+
+inline InstrBlock* CpuManager::GetBlock(const size_t offset)
+{
+	ASSERT_MSG(m_blocksMap != nullptr, "null block cache");
+	ASSERT_MSG(GetMemorySize() > offset, "block cache overflow");
+	const auto index = m_blocksMap[offset];
+	return index ? &m_blocks[index - 1] : nullptr;
+}
+
+
+inline InstrBlock* CpuManager::GetResumeBlock() { return m_resumeBlock; }
+inline void CpuManager::SetResumeBlock(InstrBlock* block) { m_resumeBlock = block; }
+
 
 inline void CpuManager::FetchOpcode()
 {
-	m_cpu.opcode = m_cpu.memory[m_cpu.pc] << 8 | m_cpu.memory[m_cpu.pc+1];
-	m_cpu.pc += 2;
+	SetOpcode(m_cpu.memory[m_cpu.pc] << 8 | m_cpu.memory[m_cpu.pc+1]);
+	m_cpu.pc = (m_cpu.pc + 2) & Cpu::ADDRESS_MASK;
+}
+
+
+// with the LAZY_VF option 8XY4 - 8XYE only record their operands,
+// VF is computed when it is read through GetRegisters or GetCpu.
+inline void CpuManager::SetLazyFlag(const uint8_t op, const uint8_t vx, const uint8_t vy)
+{
+#if defined(XCHIP_LAZY_VF)
+	m_flagOp = op;
+	m_flagVx = vx;
+	m_flagVy = vy;
+#else
+	((void)op); ((void)vx); ((void)vy);
+#endif
+}
+
+
+inline void CpuManager::ResolveFlag() const
+{
+#if defined(XCHIP_LAZY_VF)
+	if (m_flagOp != 0)
+		ComputeFlag();
+#endif
+}
+
+
+inline void CpuManager::DropFlag()
+{
+#if defined(XCHIP_LAZY_VF)
+	m_flagOp = 0;
+#endif
+}
+
+
+// xorshift32, each CpuManager has its own sequence
+inline uint32_t CpuManager::NextRandom()
+{
+	m_randState ^= m_randState << 13;
+	m_randState ^= m_randState >> 17;
+	m_randState ^= m_randState << 5;
+	return m_randState;
 }
 
 
@@ -275,20 +452,46 @@ inline void CpuManager::UnsetFlags(const uint32_t flags) { m_cpu.flags &= ~flags
 inline void CpuManager::CleanFlags() { m_cpu.flags = 0; }
 inline void CpuManager::SetDelayTimer(const uint8_t val) { m_cpu.delayTimer = val; }
 inline void CpuManager::SetSoundTimer(const uint8_t val) { m_cpu.soundTimer = val; }
-inline void CpuManager::SetOpcode(const uint16_t val) { m_cpu.opcode = val; }
-inline void CpuManager::SetIndexRegister(const size_t index) { m_cpu.I = index; }
-inline void CpuManager::SetPC(const size_t offset) { m_cpu.pc = offset; }
-inline void CpuManager::SetSP(const size_t offset) { m_cpu.sp = offset; }
+
+
+// the handlers read the operands decoded, a raw opcode is decoded here
+inline void CpuManager::SetOpcode(const uint16_t val)
+{
+	m_cpu.opcode = val;
+	m_cpu.nnn = val & 0x0fff;
+	m_cpu.x = (val & 0x0f00) >> 8;
+	m_cpu.y = (val & 0x00f0) >> 4;
+	m_cpu.nn = val & 0x00ff;
+}
+
+
+// the opcode and its operands from a decoded entry, one 8 bytes copy. 
+// a 7 bytes copy is two overlapping stores, the loads of nnn which 
+// span both can't be forwarded from them
+inline void CpuManager::SetInstr(const DecodedInstr& instr)
+{
+	std::memcpy(&m_cpu.opcode, &instr.opcode, 8);
+}
+
+inline void CpuManager::SetRandSeed(const uint32_t seed) { m_randState = seed ? seed : 0x2545F491; }
+inline void CpuManager::SetIndexRegister(const size_t index) { m_cpu.I = index & Cpu::ADDRESS_MASK; }
+inline void CpuManager::SetPC(const size_t offset) { m_cpu.pc = offset & Cpu::ADDRESS_MASK; }
+inline void CpuManager::SetSP(const size_t offset) { m_cpu.sp = static_cast<uint8_t>(offset); }
 
 
 inline void CpuManager::CleanMemory() 
 { 
-	utix::arr_zero(m_cpu.memory); 
+	memset(m_cpu.memory, 0, sizeof(m_cpu.memory));
+	CleanInstrCache();
+
+	if (m_dirtyPages != nullptr)
+		MarkDirtyPages(0, GetMemorySize());
 }
 
 inline void CpuManager::CleanRegisters() 
 { 
-	utix::arr_zero(m_cpu.registers);
+	memset(m_cpu.registers, 0, sizeof(m_cpu.registers));
+	DropFlag();
 	m_cpu.I = 0;
 	m_cpu.delayTimer = 0;
 	m_cpu.soundTimer = 0;
@@ -297,20 +500,77 @@ inline void CpuManager::CleanRegisters()
 
 inline void CpuManager::CleanStack()
 {
-	utix::arr_zero(m_cpu.stack);
+	memset(m_cpu.stack, 0, sizeof(m_cpu.stack));
 	m_cpu.sp = 0;
 }
 
 
+// gfx is expanded from the plane, the dirty rows clear it in the next ExpandGfx
 inline void CpuManager::CleanGfx() 
 { 
-	utix::arr_zero(m_cpu.gfx); 
+	GetGfxKernels().clear(m_cpu.plane, m_gfxRes.y);
+	MarkDirtyRows(0, m_gfxRes.y);
+}
+
+
+// rows y to y + count were written, wrapping around the screen height
+// like the sprites do. also sets GFX_CHANGED.
+inline void CpuManager::MarkDirtyRows(const int y, const int count)
+{
+	const int rows = m_gfxRes.y;
+	const int first = y & (rows - 1);
+	const uint64_t span = count >= 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+	uint64_t bits = (span << first) | (first ? span >> (64 - first) : 0);
+
+	if (rows < 64)
+		bits = (bits | (bits >> rows)) & ((uint64_t(1) << rows) - 1);
+
+	m_dirtyRows |= bits;
+	SetFlags(Cpu::GFX_CHANGED);
+}
+
+
+inline void CpuManager::CleanInstrCache()
+{
+	utix::arr_zero(m_instrCache);
+}
+
+
+inline void CpuManager::CleanDirtyPages()
+{
+	ASSERT_MSG(m_dirtyPages != nullptr, "null dirty pages");
+	utix::arr_zero(m_dirtyPages);
+}
+
+
+// every write to memory ends here, after the bytes are written,
+// so it also marks the written pages when dirty tracking is set.
+inline void CpuManager::InvalidateInstrCache(const size_t offset, const size_t size)
+{
+	// the entry one byte before offset holds a opcode that overlaps it,
+	// the entries up to 5 bytes before may be fused with that opcode
+	const size_t begin = offset > 5 ? offset - 5 : 0;
+	const size_t end = (offset + size) < GetMemorySize() ? (offset + size) : GetMemorySize();
+
+	for (size_t i = begin; i < end; ++i)
+		m_instrCache[i].handler = nullptr;
+
+	if (m_blocks != nullptr)
+		InvalidateBlocks(offset, size);
+
+	if (m_dirtyPages != nullptr)
+		MarkDirtyPages(offset, end - offset);
+
+	if (offset < (sizeof(m_cpu.memory) - GetMemorySize()) || (offset + size) > GetMemorySize())
+		MirrorGuard(offset, size);
 }
 
 
 
 constexpr size_t CpuManager::GetDefaultFontIndex() { return 0; }
-constexpr size_t CpuManager::GetHiResFontIndex() { return utix::arr_size(fonts::chip8DefaultFont);  }
+constexpr size_t CpuManager::GetHiResFontIndex() { return sizeof(fonts::chip8DefaultFont);  }
+constexpr utix::Vec2i CpuManager::GetMaxGfxRes() { return utix::Vec2i(128, 64); }
+constexpr size_t CpuManager::GetPageSize() { return 64; }
 
 
 
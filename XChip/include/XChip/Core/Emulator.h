@@ -29,6 +29,10 @@ along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
 #include <XChip/Plugins.h>
 #include "CpuManager.h"
 #include "Instructions.h"
+#include "Fusion.h"
+#include "Headless.h"
+#include "Pacer.h"
+#include "TripleBuffer.h"
 
 
  
@@ -38,6 +42,33 @@ using UniqueRender = UniquePlugin<iRender>;
 using UniqueInput = UniquePlugin<iInput>;
 using UniqueSound = UniquePlugin<iSound>;
 
+// code generated by XChipRecompiler: runs up to 'count' instructions
+// from the current pc, returns how many were executed. returns 0 
+// when pc is not in the recompiled code.
+using StaticCode = size_t(*)(CpuManager& cpuMan, const size_t count);
+
+
+// how instructions are executed
+enum class ExecEngine : uint8_t
+{
+	INTERPRETER, // one cached instruction at a time
+	THREADED,    // translated blocks of instructions, chained
+	JIT,         // threaded, hot blocks compiled to native code
+	FUSED,       // interpreter running common opcode pairs as one
+	STATIC       // ROM recompiled ahead of time, interpreter fallback
+};
+
+
+
+// what one RunFrame call did
+struct FrameInfo
+{
+	size_t instrs;   // instructions executed
+	bool gfxChanged; // the screen was written
+	bool sound;      // the sound timer is still running
+	bool exit;       // the EXIT flag is set
+	bool waitKey;    // FX0A waited for a key press
+};
 
 
 
@@ -52,6 +83,7 @@ public:
 
 	bool Initialize() noexcept;
 	bool Initialize(UniqueRender&& render, UniqueInput&& input, UniqueSound&& sound) noexcept;
+	bool InitializeHeadless() noexcept;
 
 	void Dispose() noexcept;
 	bool IsInitialized() const;
@@ -59,31 +91,52 @@ public:
 	bool GetInstrFlag() const;
 	bool GetDrawFlag() const;
 	bool GetExitFlag() const;
-	void HaltForNextFlag() const;
+	bool IsIdle() const;
+	bool IsVirtualClock() const;
+	bool IsThrottled() const;
 	int GetCpuFreq() const;
 	int GetFps() const;
+	uint64_t GetCycles() const;
+	PacingStats GetPacingStats() const;
+	ExecEngine GetEngine() const;
+	const FusionStats& GetFusionStats() const;
 	const iRender* GetRender() const;
 	const iInput* GetInput() const;
 	const iSound* GetSound() const;
 
 	void UpdateSystems();
+	void HaltForNextFlag();
 	void ExecuteInstr();
+	size_t RunCycles(const size_t count);
+	FrameInfo RunFrame();
+	size_t Run(const size_t count);
 	void CleanFlags();
 	void Draw();
+	void Refresh();
 	void Reset();
 
 	iRender* GetRender();
 	iInput* GetInput();
 	iSound* GetSound();
+	HeadlessRender& GetHeadlessRender();
+	HeadlessInput& GetHeadlessInput();
 
 	void SetDrawFlag(const bool val);
 	void SetExitFlag(const bool val);
 	void SetCpuFreq(const int value);
 	void SetFps(const int value);
+	void SetVirtualClock(const bool val);
+	void SetThrottle(const bool val);
+	bool SetEngine(const ExecEngine engine);
 	bool LoadRom(const std::string& fileName);
+	bool LoadRom(const uint8_t* data, const size_t size);
+	void SetStaticCode(StaticCode code);
+	void SetFrameBuffer(TripleBuffer* frames);
 	bool SetRender(UniqueRender rend);
 	bool SetInput(UniqueInput input);
 	bool SetSound(UniqueSound sound);
+	bool SetHeadlessRender();
+	bool SetHeadlessInput();
 	UniqueRender SwapRender(UniqueRender rend = nullptr);
 	UniqueInput SwapInput(UniqueInput input = nullptr);
 	UniqueSound SwapSound(UniqueSound sound = nullptr);
@@ -94,17 +147,41 @@ public:
 
 private:
  	void UpdateTimers();
-	bool InitRender();
-	bool InitInput();
-	bool InitSound();
+	size_t ExecuteCycles(const size_t count);
+	void AdvanceClock(const size_t cycles);
+	size_t GetCyclesToTick() const;
+	void TickTimers();
+	void TickFrame();
+	void PublishFrame();
+	bool InitRender(iRender* const rend);
+	bool InitInput(iInput* const input);
+	bool InitSound(iSound* const sound);
 
 	CpuManager m_manager;
 	utix::Timer m_instrTimer;
-	utix::Timer m_frameTimer;
-	utix::Timer m_chDelayTimer;
+	Pacer m_framePacer;
+	Pacer m_timersPacer;
 	UniqueRender m_renderPlugin;
 	UniqueInput m_inputPlugin;
 	UniqueSound m_soundPlugin;
+	HeadlessRender m_headlessRender;
+	HeadlessInput m_headlessInput;
+	HeadlessSound m_headlessSound;
+	JitArena m_jit;
+	FusionStats m_fusionStats = FusionStats();
+	StaticCode m_staticCode = nullptr;
+	TripleBuffer* m_frames = nullptr;
+	// the virtual clock: instructions executed, and the phases of the 
+	// 60 hz timers and of the frames, in cycles * hz since their last tick
+	uint64_t m_cycles = 0;
+	uint64_t m_timerPhase = 0;
+	uint64_t m_framePhase = 0;
+	// frames ticked since the last draw, and a full draw is due
+	int m_cleanFrames = 0;
+	bool m_refresh = true;
+	ExecEngine m_engine = ExecEngine::INTERPRETER;
+	bool m_virtualClock = false;
+	bool m_throttle = true;
 	bool m_initialized = false;
 };
 
@@ -121,11 +198,33 @@ inline const iRender* Emulator::GetRender() const { return m_manager.GetRender()
 inline const iInput* Emulator::GetInput() const { return m_manager.GetInput(); }
 inline const iSound* Emulator::GetSound() const { return m_manager.GetSound(); }
 inline int Emulator::GetCpuFreq() const { return m_instrTimer.GetTargetHz(); }
-inline int Emulator::GetFps() const { return m_frameTimer.GetTargetHz(); }
+inline int Emulator::GetFps() const { return m_framePacer.GetTargetHz(); }
+inline uint64_t Emulator::GetCycles() const { return m_cycles; }
+inline PacingStats Emulator::GetPacingStats() const { return m_framePacer.GetStats(); }
+inline bool Emulator::IsVirtualClock() const { return m_virtualClock; }
+inline bool Emulator::IsThrottled() const { return m_throttle; }
+inline ExecEngine Emulator::GetEngine() const { return m_engine; }
+inline const FusionStats& Emulator::GetFusionStats() const { return m_fusionStats; }
+
+
+inline void Emulator::SetFps(const int value) { m_framePacer.SetTargetHz(utix::Clamp(value, 10, 1000)); }
+inline void Emulator::SetThrottle(const bool val) { m_throttle = val; }
 
 
-inline void Emulator::SetCpuFreq(const int value) { m_instrTimer.SetTargetHz(utix::Clamp(value, 60, 50000)); }
-inline void Emulator::SetFps(const int value) { m_frameTimer.SetTargetHz(utix::Clamp(value, 10, 1000)); }
+// the virtual clock phases count up to the cpu frequency, they are 
+// rescaled to stay below the new one
+inline void Emulator::SetCpuFreq(const int value)
+{
+	const uint64_t old = GetCpuFreq();
+	m_instrTimer.SetTargetHz(utix::Clamp(value, 60, 50000));
+
+	if (old != 0)
+	{
+		m_timerPhase = m_timerPhase * GetCpuFreq() / old;
+		m_framePhase = m_framePhase * GetCpuFreq() / old;
+	}
+}
+
 
 inline void Emulator::SetDrawFlag(const bool val) 
 { 
@@ -136,6 +235,14 @@ inline void Emulator::SetDrawFlag(const bool val)
 }
 
 
+// the next frame is drawn in full, even if the screen didn't change.
+// for the window events the render reports.
+inline void Emulator::Refresh()
+{
+	m_refresh = true;
+}
+
+
 inline void Emulator::SetExitFlag(const bool val) 
 {
 	if (val)
@@ -147,22 +254,105 @@ inline void Emulator::SetExitFlag(const bool val)
 
 
 inline bool Emulator::LoadRom(const std::string& fname) { return m_manager.LoadRom(fname.c_str(), 0x200); }
+inline bool Emulator::LoadRom(const uint8_t* data, const size_t size) { return m_manager.LoadRom(data, size, 0x200); }
+inline void Emulator::SetStaticCode(StaticCode code) { m_staticCode = code; }
+
+// when set, each drawn frame is also published to 'frames', for a
+// render running on another thread
+inline void Emulator::SetFrameBuffer(TripleBuffer* frames) { m_frames = frames; }
 
 inline iRender* Emulator::GetRender() { return m_manager.GetRender(); }
 inline iInput* Emulator::GetInput() { return m_manager.GetInput(); }
 inline iSound* Emulator::GetSound() { return m_manager.GetSound(); }
+inline HeadlessRender& Emulator::GetHeadlessRender() { return m_headlessRender; }
+inline HeadlessInput& Emulator::GetHeadlessInput() { return m_headlessInput; }
 
+// one instruction doesn't pay for a block dispatch, THREADED and
+// JIT run it in the interpreter, their blocks run in RunCycles / RunFrame
 inline void Emulator::ExecuteInstr()
 {
-	instructions::ExecuteInstruction(m_manager);
+	if (m_engine == ExecEngine::FUSED)
+		instructions::ExecuteFused(m_manager, 1, m_fusionStats);
+	else if (m_engine != ExecEngine::STATIC || m_staticCode(m_manager, 1) == 0)
+		instructions::ExecuteInstruction(m_manager);
+
 	m_manager.UnsetFlags(Cpu::INSTR);
+
+	if (m_virtualClock)
+		AdvanceClock(1);
+}
+
+
+// executes up to 'count' instructions in one call, 
+// stops earlier if the EXIT flag is set.
+inline size_t Emulator::RunCycles(const size_t count)
+{
+	const size_t done = ExecuteCycles(count);
+
+	if (m_virtualClock)
+		AdvanceClock(done);
+
+	return done;
+}
+
+
+// executes up to 'count' instructions in the tight loop,
+// independent of the selected engine.
+inline size_t Emulator::Run(const size_t count)
+{
+	const size_t done = instructions::ExecuteLoop(m_manager, count);
+	m_manager.UnsetFlags(Cpu::INSTR);
+
+	if (m_virtualClock)
+		AdvanceClock(done);
+
+	return done;
+}
+
+
+// the selected engine, without the clock
+inline size_t Emulator::ExecuteCycles(const size_t count)
+{
+	size_t done = 0;
+
+	if (m_engine == ExecEngine::JIT)
+		done = instructions::ExecuteBlocks(m_manager, count, &m_jit);
+	else if (m_engine == ExecEngine::FUSED)
+		done = instructions::ExecuteFused(m_manager, count, m_fusionStats);
+	else if (m_engine == ExecEngine::THREADED)
+		done = instructions::ExecuteBlocks(m_manager, count);
+	else if (m_engine == ExecEngine::STATIC)
+	{
+		// the interpreter runs what was not recompiled
+		while (done < count && !m_manager.GetFlags(Cpu::EXIT))
+		{
+			const size_t ran = m_staticCode(m_manager, count - done);
+			if (ran == 0)
+				instructions::ExecuteInstruction(m_manager);
+
+			done += ran != 0 ? ran : 1;
+		}
+	}
+	else
+		for (; done < count && !m_manager.GetFlags(Cpu::EXIT); ++done)
+			instructions::ExecuteInstruction(m_manager);
+
+	m_manager.UnsetFlags(Cpu::INSTR);
+	return done;
 }
 
 
 inline void Emulator::Draw()
 {
 	ASSERT_MSG( !m_manager.GetFlags(Cpu::BAD_RENDER), "bad render!");
-	m_manager.GetRender()->DrawBuffer();
+	const uint64_t rows = m_manager.ExpandGfx();
+	m_manager.GetRender()->DrawRows(m_refresh ? ~uint64_t(0) : rows);
+	m_refresh = false;
+	m_cleanFrames = 0;
+
+	if (m_frames != nullptr)
+		PublishFrame();
+
 	m_manager.UnsetFlags(Cpu::DRAW);
 }
 
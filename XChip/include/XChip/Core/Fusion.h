@@ -0,0 +1,71 @@
+/*
+
+XChip - A chip8 lib and emulator.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+#ifndef XCHIP_CORE_FUSION_H_
+#define XCHIP_CORE_FUSION_H_
+#include <Utix/Ints.h>
+#include "CpuManager.h"
+
+
+namespace xchip {
+
+
+
+// superinstructions: adjacent opcode pairs and triples executed by 
+// one handler. fired[] counts how many times each one was fused.
+struct FusionStats
+{
+	enum Kind : uint8_t
+	{
+		SKIP_EQ_JUMP,   // 3XNN 1NNN
+		SKIP_NE_JUMP,   // 4XNN 1NNN
+		TIMER_SKIP_EQ,  // FX07 3XNN
+		TIMER_SKIP_NE,  // FX07 4XNN
+		ADD_SKIP_EQ,    // 7XNN 3XNN
+		ADD_SKIP_NE,    // 7XNN 4XNN
+		SET_I_ADD_I,    // ANNN FX1E
+		SET_I_DRAW,     // ANNN DXYN
+		SET_SET,        // 6XNN 6XNN
+		TIMER_WAIT_EQ,  // FX07 3XNN 1NNN
+		TIMER_WAIT_NE,  // FX07 4XNN 1NNN
+		ADD_LOOP_EQ,    // 7XNN 3XNN 1NNN
+		ADD_LOOP_NE,    // 7XNN 4XNN 1NNN
+		COUNT
+	};
+
+	size_t fired[COUNT];
+
+	static const char* GetName(const Kind kind);
+};
+
+
+
+namespace instructions {
+extern size_t ExecuteFused(CpuManager&, const size_t count, FusionStats& stats);
+}
+
+
+
+
+}
+
+
+
+#endif // XCHIP_CORE_FUSION_H_
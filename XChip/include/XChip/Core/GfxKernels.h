@@ -0,0 +1,62 @@
+/*
+
+XChip - A chip8 lib and emulator.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+#ifndef XCHIP_CORE_GFXKERNELS_H_
+#define XCHIP_CORE_GFXKERNELS_H_
+#include <Utix/Ints.h>
+
+
+namespace xchip {
+
+
+
+// operations on the 1bpp plane ( Cpu::plane, 2 words per row ).
+// rows is the plane height, width is 64 or 128. sprite holds
+// 2 words per sprite row, already rotated to the sprite x.
+// functions returning bool return true on a collision / if equal.
+struct GfxKernels
+{
+	enum Level : uint8_t { SCALAR, SSE2, AVX2 };
+
+	void(*clear)(uint64_t* plane, const int rows);
+	void(*scrollRight)(uint64_t* plane, const int rows, const int width);
+	void(*scrollLeft)(uint64_t* plane, const int rows, const int width);
+	void(*scrollDown)(uint64_t* plane, const int rows, const int lines);
+	bool(*xorSprite)(uint64_t* plane, const int rows, const uint64_t* sprite, const int y, const int height);
+	bool(*compare)(const uint64_t* planeA, const uint64_t* planeB, const int rows);
+	void(*expand)(const uint64_t* plane, uint32_t* gfx, const int rows, const int width);
+	Level level;
+	const char* name;
+};
+
+
+// the kernels for 'level', nullptr if the cpu doesn't support it.
+extern const GfxKernels* FindGfxKernels(const GfxKernels::Level level);
+
+// the best kernels for this cpu, selected on the first call
+extern const GfxKernels& GetGfxKernels();
+
+
+
+}
+
+
+
+#endif // XCHIP_CORE_GFXKERNELS_H_
@@ -0,0 +1,173 @@
+/*
+
+XChip - A chip8 lib and emulator.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+#ifndef XCHIP_CORE_HEADLESS_H_
+#define XCHIP_CORE_HEADLESS_H_
+
+#include <Utix/Ints.h>
+#include <XChip/Plugins/iRender.h>
+#include <XChip/Plugins/iInput.h>
+#include <XChip/Plugins/iSound.h>
+
+
+
+// built in plugins for running with no display, audio or keyboard.
+// they are owned by the Emulator, not loaded from a shared library.
+namespace xchip {
+
+
+// keeps the buffer and the resolution, draws nothing
+class HeadlessRender final : public iRender
+{
+public:
+	bool Initialize(const utix::Vec2i& winSize, const utix::Vec2i& resolution) noexcept override;
+	void Dispose() noexcept override;
+	bool IsInitialized() const noexcept override;
+	const char* GetPluginName() const noexcept override;
+	const char* GetPluginVersion() const noexcept override;
+	PluginDeleter GetPluginDeleter() const noexcept override;
+
+	const char* GetWindowName() const noexcept override;
+	const uint32_t* GetBuffer() const noexcept override;
+	utix::Vec2i GetResolution() const noexcept override;
+	utix::Vec2i GetWindowSize() const noexcept override;
+	utix::Vec2i GetWindowPosition() const noexcept override;
+	utix::Color GetDrawColor() const noexcept override;
+	utix::Color GetBackgroundColor() const noexcept override;
+	size_t GetFrames() const noexcept;
+
+	bool UpdateEvents() noexcept override;
+	void SetWindowName(const char* name) noexcept override;
+	bool SetResolution(const utix::Vec2i& res) noexcept override;
+	void SetWindowSize(const utix::Vec2i& size) noexcept override;
+	void SetWindowPosition(const utix::Vec2i& pos) noexcept override;
+	bool SetDrawColor(const utix::Color& color) noexcept override;
+	bool SetBackgroundColor(const utix::Color& color) noexcept override;
+	bool SetFullScreen(const bool option) noexcept override;
+	void SetBuffer(const uint32_t* gfx) noexcept override;
+	void DrawBuffer() noexcept override;
+	void HideWindow() noexcept override;
+	void ShowWindow() noexcept override;
+	void SetWinCloseCallback(const void* arg, WinCloseCallback callback) noexcept override;
+	void SetWinResizeCallback(const void* arg, WinResizeCallback callack) noexcept override;
+
+private:
+	const uint32_t* m_buffer = nullptr;
+	size_t m_frames = 0;
+	utix::Vec2i m_res = {0, 0};
+	utix::Vec2i m_maxRes = {0, 0};
+	utix::Vec2i m_winSize = {0, 0};
+	utix::Vec2i m_winPos = {0, 0};
+	utix::Color m_color = {255, 255, 255};
+	utix::Color m_bkgColor = {0, 0, 0};
+	bool m_initialized = false;
+};
+
+
+
+
+// the keys are set by the program, a bit per Key. the key
+// source, when set, gives the keys at every UpdateKeys.
+class HeadlessInput final : public iInput
+{
+public:
+	using KeySource = uint32_t(*)(const void*);
+
+	bool Initialize() noexcept override;
+	void Dispose() noexcept override;
+	bool IsInitialized() const noexcept override;
+	const char* GetPluginName() const noexcept override;
+	const char* GetPluginVersion() const noexcept override;
+	PluginDeleter GetPluginDeleter() const noexcept override;
+
+	bool IsKeyPressed(const Key key) const noexcept override;
+	bool UpdateKeys() noexcept override;
+	Key WaitKeyPress() noexcept override;
+	uint32_t GetKeys() const noexcept;
+	void SetKeys(const uint32_t keys) noexcept;
+	void SetKeySource(const void* arg, KeySource source) noexcept;
+
+	void SetWaitKeyCallback(const void* arg, WaitKeyCallback callback) noexcept override;
+	void SetResetKeyCallback(const void* arg, ResetKeyCallback callback) noexcept override;
+	void SetEscapeKeyCallback(const void* arg, EscapeKeyCallback callback) noexcept override;
+
+private:
+	uint32_t m_keys = 0;
+	KeySource m_source = nullptr;
+	const void* m_sourceArg = nullptr;
+	WaitKeyCallback m_waitClbk = nullptr;
+	ResetKeyCallback m_resetClbk = nullptr;
+	EscapeKeyCallback m_escapeClbk = nullptr;
+	const void* m_waitClbkArg = nullptr;
+	const void* m_resetClbkArg = nullptr;
+	const void* m_escapeClbkArg = nullptr;
+	bool m_initialized = false;
+};
+
+
+
+
+// plays nothing
+class HeadlessSound final : public iSound
+{
+public:
+	bool Initialize() noexcept override;
+	void Dispose() noexcept override;
+	bool IsInitialized() const noexcept override;
+	const char* GetPluginName() const noexcept override;
+	const char* GetPluginVersion() const noexcept override;
+	PluginDeleter GetPluginDeleter() const noexcept override;
+
+	bool IsPlaying() const noexcept override;
+	float GetCountdownFreq() const noexcept override;
+	float GetSoundFreq() const noexcept override;
+	void SetCountdownFreq(const float hz) noexcept override;
+	void SetSoundFreq(const float hz) noexcept override;
+	void Play(const uint8_t soundTimer) noexcept override;
+	void Stop() noexcept override;
+
+private:
+	float m_countdownFreq = 60;
+	float m_soundFreq = 450;
+	bool m_initialized = false;
+};
+
+
+
+
+inline size_t HeadlessRender::GetFrames() const noexcept { return m_frames; }
+inline uint32_t HeadlessInput::GetKeys() const noexcept { return m_keys; }
+inline void HeadlessInput::SetKeys(const uint32_t keys) noexcept { m_keys = keys; }
+
+inline void HeadlessInput::SetKeySource(const void* arg, KeySource source) noexcept
+{
+	m_sourceArg = arg;
+	m_source = source;
+}
+
+
+
+
+}
+
+
+
+
+#endif // XCHIP_CORE_HEADLESS_H_
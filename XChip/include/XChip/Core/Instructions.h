@@ -22,19 +22,30 @@ along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
 #ifndef XCHIP_CORE_INSTRUCTIONS_H_
 #define XCHIP_CORE_INSTRUCTIONS_H_
 #include "CpuManager.h"
+#include "Jit.h"
  
 namespace xchip { namespace instructions {
 
 
 
 using InstrTable = void(*)(CpuManager&);
-extern InstrTable instrTable[16];
+extern const InstrTable instrTable[16];
 
+#if defined(XCHIP_OPCODE_TABLE)
+extern const InstrTable* const opcodeTable; // 0x10000 handlers, one per opcode
+#endif
+
+extern void UnknownOpcode(CpuManager&);
 extern void ExecuteInstruction(CpuManager&);
+extern size_t ExecuteBlocks(CpuManager&, const size_t count, JitArena* jit = nullptr);
+extern size_t ExecuteLoop(CpuManager&, const size_t count);
+extern DecodedInstr DecodeInstruction(const uint16_t opcode);
 
 
 // Primary table
 extern void op_0xxx(CpuManager&); // 3 instructions switch
+extern void op_00E0(CpuManager&); // clears the screen
+extern void op_00EE(CpuManager&); // returns from a subroutine
 extern void op_1NNN(CpuManager&); // jumps to address NNN
 extern void op_2NNN(CpuManager&); // calls subroutine at NNN
 extern void op_3XNN(CpuManager&); // Skips the next instruction if VX equals NN
@@ -49,6 +60,8 @@ extern void op_CXNN(CpuManager&); // Sets VX to the result of a bitwise AND oper
 extern void op_DXYN(CpuManager&); // DRAW Instruction .....
 extern void op_DXYN_ex(CpuManager&); // DRAW Instruction extended mode
 extern void op_EXxx(CpuManager&); // 2 instruction EX9E, EXA1
+extern void op_EX9E(CpuManager&); // Skips the next instruction if the key stored in VX is pressed
+extern void op_EXA1(CpuManager&); // Skips the next instruction if the key stored in VX isn't pressed
 // Primary table end
 
 
@@ -75,6 +88,11 @@ extern void op_FX30(CpuManager&); // FX30* SuperChip: Point I to the location of
 extern void op_FX07(CpuManager&); // FX07   Sets VX to the value of the delay timer.
 extern void op_FX0A(CpuManager&); // FX0A   A key press is awaited, and then stored in VX.
 extern void op_FXx5(CpuManager&); // 3 instructions switch
+extern void op_FX15(CpuManager&); // FX15   Sets the delay timer to VX.
+extern void op_FX55(CpuManager&); // FX55   Stores V0 to VX in memory starting at address I
+extern void op_FX65(CpuManager&); // FX65   Fills V0 to VX with values from memory starting at address I
+extern void op_FX75(CpuManager&); // FX75*  SuperChip: Store V0...VX in RPL user flags
+extern void op_FX85(CpuManager&); // FX85*  SuperChip: Read V0...VX from RPL user flags
 extern void op_FX18(CpuManager&); // FX18   Sets the sound timer to VX.
 extern void op_FX1E(CpuManager&); // FX1E   Adds VX to I.
 extern void op_FX29(CpuManager&); // FX29  Sets I to the location of the sprite for the character in VX. 
@@ -0,0 +1,97 @@
+/*
+
+XChip - A chip8 lib and emulator.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+#ifndef XCHIP_CORE_JIT_H_
+#define XCHIP_CORE_JIT_H_
+#include <Utix/Ints.h>
+#include "Cpu.h"
+
+
+namespace xchip {
+
+
+
+// executable memory where hot InstrBlocks are compiled to native code.
+// only Linux x86-64 is supported, on other targets Initialize fails
+// and the blocks stay in the threaded interpreter.
+class JitArena
+{
+public:
+	JitArena() noexcept;
+	~JitArena();
+	JitArena(const JitArena&) = delete;
+	JitArena& operator=(const JitArena&) = delete;
+
+	bool Initialize(const size_t size) noexcept;
+	void Dispose() noexcept;
+	bool IsInitialized() const;
+	bool IsFull() const;
+	size_t GetSize() const;
+	size_t GetUsedSize() const;
+
+	bool Compile(InstrBlock& block);
+	void Clean();
+
+	static constexpr bool IsSupported();
+	static constexpr uint32_t GetHotThreshold();
+
+private:
+	uint8_t* m_code = nullptr;
+	size_t m_size = 0;
+	size_t m_used = 0;
+	bool m_full = false;
+};
+
+
+
+
+inline bool JitArena::IsInitialized() const { return m_code != nullptr; }
+inline bool JitArena::IsFull() const { return m_full; }
+inline size_t JitArena::GetSize() const { return m_size; }
+inline size_t JitArena::GetUsedSize() const { return m_used; }
+
+inline void JitArena::Clean()
+{
+	m_used = 0;
+	m_full = false;
+}
+
+
+constexpr bool JitArena::IsSupported()
+{
+#if defined(__linux__) && defined(__x86_64__)
+	return true;
+#else
+	return false;
+#endif
+}
+
+// times a block is interpreted before it gets compiled
+constexpr uint32_t JitArena::GetHotThreshold() { return 32; }
+
+
+
+
+
+}
+
+
+
+#endif // XCHIP_CORE_JIT_H_
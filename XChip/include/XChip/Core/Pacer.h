@@ -0,0 +1,131 @@
+/*
+
+XChip - A chip8 lib and emulator.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+#ifndef XCHIP_CORE_PACER_H_
+#define XCHIP_CORE_PACER_H_
+
+#include <chrono>
+#include <Utix/Ints.h>
+#include <Utix/Timer.h>
+
+
+namespace xchip {
+
+
+// interval error of the last paced periods: | interval - period |
+struct PacingStats
+{
+	size_t periods;      // periods paced since Start
+	size_t missed;       // late by over a period, the schedule restarted
+	utix::Duration p50;
+	utix::Duration p99;
+	utix::Duration max;
+	utix::Duration spin; // the current spin before each deadline
+};
+
+
+
+
+// paces a period on absolute deadlines: each deadline is the last one
+// plus the period, so waking up late doesn't move the next ones and the
+// long run rate is exact. sleeps are done to a bit before the deadline,
+// then the rest is spun. the spin is calibrated from how much the sleeps
+// overslept.
+class Pacer
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	int GetTargetHz() const;
+	utix::Duration GetPeriod() const;
+	utix::Duration GetRemain() const;
+	PacingStats GetStats() const;
+
+	void SetTargetHz(const int hz);
+	void SetPeriod(const utix::Duration period);
+	void Start();
+	bool Tick();
+	bool Wait();
+	void SleepFor(const utix::Duration time);
+	void SleepUntil(const Clock::time_point time);
+
+private:
+	void Record(const Clock::time_point now);
+
+	static constexpr size_t windowSize = 256;
+	Clock::time_point m_deadline;
+	Clock::time_point m_last;
+	utix::Duration m_period = utix::Duration(1);
+	utix::Duration m_spin = std::chrono::microseconds(100);
+	size_t m_periods = 0;
+	size_t m_missed = 0;
+	int64_t m_errors[windowSize];
+};
+
+
+
+
+inline int Pacer::GetTargetHz() const { return static_cast<int>(1000000000 / m_period.count()); }
+inline utix::Duration Pacer::GetPeriod() const { return m_period; }
+inline void Pacer::SetTargetHz(const int hz) { m_period = utix::Duration(1000000000 / hz); }
+inline void Pacer::SetPeriod(const utix::Duration period) { m_period = period; }
+inline void Pacer::SleepFor(const utix::Duration time) { SleepUntil(Clock::now() + time); }
+
+
+inline utix::Duration Pacer::GetRemain() const
+{
+	const auto now = Clock::now();
+	return now < m_deadline ? std::chrono::duration_cast<utix::Duration>(m_deadline - now) : utix::Duration(0);
+}
+
+
+
+// true once the deadline passed, then the deadline moves a period
+inline bool Pacer::Tick()
+{
+	const auto now = Clock::now();
+
+	if (now < m_deadline)
+		return false;
+
+	Record(now);
+	return true;
+}
+
+
+
+// sleeps to the deadline, false when it was already missed by over a period
+inline bool Pacer::Wait()
+{
+	SleepUntil(m_deadline);
+	const size_t missed = m_missed;
+	Record(Clock::now());
+	return missed == m_missed;
+}
+
+
+
+
+}
+
+
+
+
+#endif // XCHIP_CORE_PACER_H_
@@ -0,0 +1,100 @@
+/*
+
+XChip - A chip8 lib and emulator.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+#ifndef XCHIP_CORE_TRIPLEBUFFER_H_
+#define XCHIP_CORE_TRIPLEBUFFER_H_
+
+#include <atomic>
+#include <Utix/Ints.h>
+#include <Utix/Vector2.h>
+#include "CpuManager.h"
+
+
+namespace xchip {
+
+
+// a screen as expanded by CpuManager::ExpandGfx
+struct Frame
+{
+	uint32_t pixels[CpuManager::GetMaxGfxRes().x * CpuManager::GetMaxGfxRes().y];
+	utix::Vec2i res;
+	uint64_t number; // frames published before this one
+};
+
+
+
+
+// passes frames from one writer thread to one reader thread with no
+// locks: the writer fills the back frame and publishes it, the reader
+// takes the latest published one. neither waits for the other, frames
+// the reader didn't take in time are dropped.
+class TripleBuffer
+{
+public:
+	Frame& GetBack();
+	const Frame& GetFront() const;
+	void Publish();
+	bool Acquire();
+
+private:
+	// index of the middle frame, with the fresh bit while not acquired
+	static constexpr uint8_t fresh = 0x4;
+	Frame m_frames[3];
+	std::atomic<uint8_t> m_middle { 1 };
+	uint8_t m_back = 0;
+	uint8_t m_front = 2;
+	uint64_t m_published = 0;
+};
+
+
+
+
+inline Frame& TripleBuffer::GetBack() { return m_frames[m_back]; }
+inline const Frame& TripleBuffer::GetFront() const { return m_frames[m_front]; }
+
+
+// the back frame becomes the middle one, the old middle the back
+inline void TripleBuffer::Publish()
+{
+	m_frames[m_back].number = m_published++;
+	m_back = m_middle.exchange(m_back | fresh, std::memory_order_acq_rel) & ~fresh;
+}
+
+
+// true when a frame was published since the last Acquire,
+// then it is the front frame
+inline bool TripleBuffer::Acquire()
+{
+	if (!(m_middle.load(std::memory_order_relaxed) & fresh))
+		return false;
+
+	m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & ~fresh;
+	return true;
+}
+
+
+
+
+}
+
+
+
+
+#endif // XCHIP_CORE_TRIPLEBUFFER_H_
@@ -64,6 +64,7 @@ public:
 	bool SetFullScreen(const bool option) noexcept override;
 	bool UpdateEvents() noexcept override;
 	void DrawBuffer() noexcept override;
+	void DrawRows(const uint64_t rows) noexcept override;
 	void HideWindow() noexcept override;
 	void ShowWindow() noexcept override;
 
@@ -72,6 +73,7 @@ public:
 
 private:
 	bool CreateTexture(const int w, const int h);
+	void Present();
 	SDL_Event m_sdlevent;
 	SDL_Window* m_window = nullptr;
 	SDL_Renderer* m_rend = nullptr;
@@ -81,7 +83,11 @@ private:
 	WinResizeCallback m_resizeClbk = nullptr;
 	const void* m_closeClbkArg;
 	const void* m_resizeClbkArg;
+	utix::Vec2i m_res;
+	utix::Vec2i m_textureRes;
 	int m_pitch;
+	// the texture or the window need a full draw
+	bool m_redraw = true;
 	bool m_initialized = false;
 };
 
@@ -199,6 +199,18 @@ bool UniquePlugin<T>::Load(const std::string& dlPath)
 		return false;
 
 
+	// an older plugin has a smaller vtable, calling the new entries would crash
+	const auto pluginVersion = reinterpret_cast<PluginVersion>( newLoader.GetSymbol(XCHIP_PLUGIN_VERSION_SYM) );
+	const int version = pluginVersion ? pluginVersion() : 1;
+
+	if (version != XCHIP_PLUGIN_INTERFACE_VERSION)
+	{
+		LogError("Plugin %s is built for the plugin interface %d, it must be rebuilt for %d", 
+		          dlPath.c_str(), version, XCHIP_PLUGIN_INTERFACE_VERSION);
+		return false;
+	}
+
+
 	const auto pluginLoader = reinterpret_cast<PluginLoader>( newLoader.GetSymbol(XCHIP_LOAD_PLUGIN_SYM) );
 
 	if (!pluginLoader)
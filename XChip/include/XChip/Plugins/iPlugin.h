@@ -33,6 +33,14 @@ along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
 
 #define XCHIP_LOAD_PLUGIN_SYM "XCHIP_LoadPlugin"
 #define XCHIP_FREE_PLUGIN_SYM "XCHIP_FreePlugin"
+#define XCHIP_PLUGIN_VERSION_SYM "XCHIP_PluginVersion"
+
+// version of the plugin interfaces, bumped when a vtable or a contract
+// changes. plugins export it as XCHIP_PluginVersion and the ones built
+// for another version ( or without it ) are not loaded.
+// 2: iRender::DrawRows added, iRender::UpdateEvents returns true when
+//    the window must be drawn again.
+#define XCHIP_PLUGIN_INTERFACE_VERSION 2
 
 
 namespace xchip {
@@ -42,6 +50,7 @@ namespace xchip {
 class iPlugin;
 using PluginLoader = iPlugin* (*)();
 using PluginDeleter = void(*)(const iPlugin*);
+using PluginVersion = int(*)();
 
 
 class iPlugin
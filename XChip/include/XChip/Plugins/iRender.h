@@ -45,6 +45,10 @@ public:
 	virtual utix::Color GetDrawColor() const noexcept = 0;
 	virtual utix::Color GetBackgroundColor() const noexcept = 0;
 
+	// polls the window events. returns true when the window must be drawn
+	// again ( exposed, resized, restored ) even if the buffer didn't change,
+	// the emulator then draws every row. since plugin interface 2, before
+	// it the return value was not used.
 	virtual bool UpdateEvents() noexcept = 0;
 	virtual void SetWindowName(const char* name) noexcept = 0;
 	virtual bool SetResolution(const utix::Vec2i& res) noexcept = 0;
@@ -59,6 +63,11 @@ public:
 	virtual void ShowWindow() noexcept = 0;
 	virtual void SetWinCloseCallback(const void* arg, WinCloseCallback callback) noexcept = 0;
 	virtual void SetWinResizeCallback(const void* arg, WinResizeCallback callack) noexcept = 0;
+
+	// draws the buffer knowing only 'rows' changed since the last draw,
+	// a bit per row ( bit y for row y ), 0 for none. renders which can't
+	// use it draw the whole buffer. added in plugin interface 2.
+	virtual void DrawRows(const uint64_t /*rows*/) noexcept { DrawBuffer(); }
 };
 
 
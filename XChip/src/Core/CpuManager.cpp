@@ -18,6 +18,7 @@ along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
 
 */
 
+#include <algorithm>
 
 #include <Utix/Log.h>
 #include <Utix/ScopeExit.h>
@@ -39,8 +40,6 @@ inline void set_plugin_flag(Cpu::Flags flag, const iPlugin* plugin, CpuManager&
 template<class T>
 inline bool alloc_cpu_arr(const size_t size, T*&);
 template<class T>
-inline bool realloc_cpu_arr(const size_t size, T*&);
-template<class T>
 inline void free_cpu_arr(T*& arr);
 
 
@@ -67,70 +66,154 @@ CpuManager::~CpuManager()
 
 void CpuManager::Dispose() noexcept
 {
+	free_cpu_arr(m_cpu.plane);
 	free_cpu_arr(m_cpu.gfx);
-	free_cpu_arr(m_cpu.stack);
-	free_cpu_arr(m_cpu.registers);
-	free_cpu_arr(m_cpu.memory);
+	m_gfxRes = 0;
+	DropFlag();
+	free_cpu_arr(m_dirtyPages);
+	free_cpu_arr(m_codeMap);
+	free_cpu_arr(m_blocksMap);
+	free_cpu_arr(m_blocksCode);
+	free_cpu_arr(m_blocks);
+	free_cpu_arr(m_instrCache);
+	m_resumeBlock = nullptr;
 }
 
 
+// the address space is inline in Cpu, 'size' must fit in it.
+// allocates the caches which have one entry per memory address.
 bool CpuManager::SetMemory(const size_t size)
 {
-	if (alloc_cpu_arr(size, m_cpu.memory))
-		return true;
+	if (size > GetMemorySize())
+	{
+		LogError("Cpu memory size %zu is over the address space: %zu", size, GetMemorySize());
+		return false;
+	}
+
+	if (alloc_cpu_arr(GetMemorySize(), m_instrCache))
+	{
+		CleanInstrCache();
 
-	LogError("Cannot allocate Cpu memory size: %zu", size);
+		if (m_blocks == nullptr)
+			return true;
+		
+		// the block cache maps are sized by memory too
+		return SetBlockCache(arr_size(m_blocks), arr_size(m_blocksCode));
+	}
+
+	LogError("Cannot allocate Cpu instruction cache size: %zu", GetMemorySize());
 	return false;
 }
 
 
 
-bool CpuManager::SetRegisters(const size_t size)
+bool CpuManager::SetGfxRes(const Vec2i& res)
 {
-	if (alloc_cpu_arr(size, m_cpu.registers))
+	return SetGfxRes(res.x, res.y);
+}
+
+
+
+// the plane rows are 128 bits, the width is 64 or 128. gfx and plane
+// are allocated once for the max resolution, so 00FE / 00FF only change
+// the view. a new resolution starts cleared, like a new buffer.
+bool CpuManager::SetGfxRes(const int w, const int h)
+{
+	ASSERT_MSG(w == 64 || w == 128, "plane width must be 64 or 128");
+	ASSERT_MSG(h > 0 && h <= GetMaxGfxRes().y, "plane height over the max resolution");
+
+	const auto maxRes = GetMaxGfxRes();
+
+	if (alloc_cpu_arr(maxRes.x * maxRes.y, m_cpu.gfx) && alloc_cpu_arr(maxRes.y * 2, m_cpu.plane)) 
+	{
+		if (m_gfxRes.x != w || m_gfxRes.y != h)
+		{
+			m_gfxRes.x = w;
+			m_gfxRes.y = h;
+			CleanGfx();
+		}
+
 		return true;
+	}
 
-	LogError("Cannot allocate Cpu registers size: %zu", size);
+	LogError("Cannot allocate Cpu memory size: %d", maxRes.x * maxRes.y);
+	m_gfxRes = 0;
 	return false;
 }
 
 
-bool CpuManager::SetStack(const size_t size)
+
+
+// writes the plane rows written since the last call to the gfx buffer
+// given to iRender, returns them as the bits of GetDirtyRows
+uint64_t CpuManager::ExpandGfx()
 {
-	if (alloc_cpu_arr(size, m_cpu.stack))
-		return true;
+	const uint64_t dirty = m_dirtyRows;
+	const int width = m_gfxRes.x;
+	int y = 0;
 
-	LogError("Cannot allocate Cpu stack size: %zu", size);
-	return false;
+	// one expand per run of dirty rows
+	while (y < m_gfxRes.y)
+	{
+		if (!(dirty & (uint64_t(1) << y))) {
+			++y;
+			continue;
+		}
+
+		const int first = y;
+		while (y < m_gfxRes.y && (dirty & (uint64_t(1) << y)))
+			++y;
+
+		GetGfxKernels().expand(m_cpu.plane + first * 2, m_cpu.gfx + first * width, y - first, width);
+	}
+
+	m_dirtyRows = 0;
+	return dirty;
 }
 
 
-bool CpuManager::SetGfxRes(const Vec2i& res)
+
+
+
+bool CpuManager::SetBlockCache(const size_t blocks, const size_t instrs)
 {
-	if (alloc_cpu_arr(res.x * res.y, m_cpu.gfx)) 
+	ASSERT_MSG(m_instrCache != nullptr, "null instruction cache");
+	ASSERT_MSG(blocks < 0xFFFF, "blocks count is over the blocks map range");
+
+	const auto memSize = GetMemorySize();
+
+	if (alloc_cpu_arr(blocks, m_blocks) 
+		&& alloc_cpu_arr(instrs, m_blocksCode)
+		&& alloc_cpu_arr(memSize, m_blocksMap)
+		&& alloc_cpu_arr(memSize, m_codeMap))
 	{
-		m_gfxRes = res;
+		CleanBlockCache();
 		return true;
 	}
 
-	LogError("Cannot allocate Cpu memory size: %d", + res.x*res.y);
-	m_gfxRes = 0;
+	LogError("Cannot allocate block cache for %zu blocks, %zu instructions", blocks, instrs);
+	free_cpu_arr(m_codeMap);
+	free_cpu_arr(m_blocksMap);
+	free_cpu_arr(m_blocksCode);
+	free_cpu_arr(m_blocks);
 	return false;
 }
 
 
 
-bool CpuManager::SetGfxRes(const int w, const int h)
+
+
+// a bit per GetPageSize() bytes of the address space, all clean.
+// writers mark it through InvalidateInstrCache, pointers from GetMemory must too.
+bool CpuManager::SetDirtyTracking()
 {
-	if (alloc_cpu_arr(w * h, m_cpu.gfx)) 
+	if (alloc_cpu_arr(GetMemorySize() / GetPageSize() / 64, m_dirtyPages))
 	{
-		m_gfxRes.x = w;
-		m_gfxRes.y = h;
+		CleanDirtyPages();
 		return true;
 	}
 
-	LogError("Cannot allocate Cpu memory size: %d", w*h);
-	m_gfxRes = 0;
+	LogError("Cannot allocate dirty pages bitmap");
 	return false;
 }
 
@@ -138,40 +221,136 @@ bool CpuManager::SetGfxRes(const int w, const int h)
 
 
 
-bool CpuManager::ResizeMemory(const std::size_t size)
+InstrBlock* CpuManager::NewBlock(const size_t offset, const size_t size)
 {
-	if (realloc_cpu_arr(size, m_cpu.memory)) 
-		return true;
+	ASSERT_MSG(m_blocks != nullptr, "null block cache");
+	ASSERT_MSG(size > 0 && size <= arr_size(m_blocksCode), "invalid block size");
+	ASSERT_MSG((offset + size * 2) <= GetMemorySize(), "block overflows memory");
+
+	// when out of space, drop every block and start over
+	if (m_blocksUsed == arr_size(m_blocks) || (arr_size(m_blocksCode) - m_blocksCodeUsed) < size)
+		CleanBlockCache();
+
+	auto& block = m_blocks[m_blocksUsed++];
+	block.code = m_blocksCode + m_blocksCodeUsed;
+	block.next[0] = block.next[1] = nullptr;
+	block.native = nullptr;
+	block.hits = 0;
+	block.begin = static_cast<uint16_t>(offset);
+	block.end = static_cast<uint32_t>(offset + size * 2);
+	block.size = static_cast<uint16_t>(size);
+	block.valid = true;
+
+	m_blocksCodeUsed += size;
+	m_blocksMap[offset] = static_cast<uint16_t>(m_blocksUsed);
+	// count the blocks over each byte, a saturated count stays code
+	for (size_t i = offset; i < block.end; ++i)
+		m_codeMap[i] += m_codeMap[i] != 0xFF;
+
+	return &block;
+}
 
 
-	LogError("Cannot reallocate Cpu memory to size: %zu", size);
-	return false;
+
+void CpuManager::CleanBlockCache()
+{
+	m_blocksUsed = 0;
+	m_blocksCodeUsed = 0;
+	m_resumeBlock = nullptr;
+	arr_zero(m_blocksMap);
+	arr_zero(m_codeMap);
 }
 
 
 
-bool CpuManager::ResizeRegisters(const size_t size)
+void CpuManager::InvalidateBlocks(const size_t offset, const size_t size)
 {
-	if (realloc_cpu_arr(size, m_cpu.registers))
-		return true;
+	const size_t end = (offset + size) < GetMemorySize() ? (offset + size) : GetMemorySize();
 
-	LogError("Cannot reallocate Cpu registers to size: %zu",  size);
-	return false;
+	// most writes are data writes, check if any translated byte was hit first
+	size_t i = offset;
+	while (i < end && !m_codeMap[i])
+		++i;
+
+	if (i == end)
+		return;
+
+	for (size_t b = 0; b < m_blocksUsed; ++b)
+	{
+		auto& block = m_blocks[b];
+		if (block.valid && block.begin < end && offset < block.end)
+		{
+			block.valid = false;
+			if (m_blocksMap[block.begin] == b + 1)
+				m_blocksMap[block.begin] = 0;
+
+			// the bytes left without blocks are data again, writes to them skip this scan
+			for (size_t j = block.begin; j < block.end; ++j)
+				m_codeMap[j] -= m_codeMap[j] != 0xFF;
+		}
+	}
 }
 
 
 
 
-bool CpuManager::ResizeStack(const size_t size)
+// the guard bytes mirror the first bytes of memory, so the accesses
+// running past 0xFFFF wrap around to 0x0000 as the address does.
+void CpuManager::MirrorGuard(const size_t offset, const size_t size)
 {
-	if (realloc_cpu_arr(size, m_cpu.stack))
-		return true;
+	constexpr size_t guardSize = sizeof(m_cpu.memory) - Cpu::ADDRESS_SPACE;
+	uint8_t* const guard = m_cpu.memory + Cpu::ADDRESS_SPACE;
+	const size_t end = offset + size;
 
-	LogError("Cannot reallocate Cpu stack to size: %zu", size);
-	return false;
+	if (offset < guardSize)
+		memcpy(guard + offset, m_cpu.memory + offset, (end < guardSize ? end : guardSize) - offset);
+
+	// the bytes written in the guard belong to the memory start
+	if (end > Cpu::ADDRESS_SPACE) 
+	{
+		const size_t wrapped = end - Cpu::ADDRESS_SPACE;
+		memcpy(m_cpu.memory, guard, wrapped);
+		InvalidateInstrCache(0, wrapped);
+	}
 }
 
 
+
+
+void CpuManager::MarkDirtyPages(const size_t offset, const size_t size)
+{
+	const size_t last = (offset + size - 1) / GetPageSize();
+	for (size_t page = offset / GetPageSize(); size && page <= last; ++page)
+		m_dirtyPages[page / 64] |= uint64_t(1) << (page % 64);
+}
+
+
+
+
+// stores the VF of the last 8XY4 - 8XYE, like the handlers compute it
+void CpuManager::ComputeFlag() const
+{
+#if defined(XCHIP_LAZY_VF)
+	uint8_t flag;
+
+	switch (m_flagOp)
+	{
+		case 0x4: flag = (m_flagVx + m_flagVy) > 0xff ? 1 : 0; break;
+		case 0x5: flag = m_flagVy > m_flagVx ? 0 : 1; break;
+		case 0x6: flag = m_flagVx & 0x1; break;
+		case 0x7: flag = m_flagVx > m_flagVy ? 0 : 1; break;
+		default:  flag = (m_flagVx & 0x80) == 0x80 ? 1 : 0; break;
+	}
+
+	// VF holds its value already, only its computation was deferred
+	const_cast<uint8_t&>(m_cpu.registers[0xF]) = flag;
+	m_flagOp = 0;
+#endif
+}
+
+
+
+
 void CpuManager::LoadDefaultFont()
 {
 	using namespace xchip::fonts;
@@ -179,10 +358,8 @@ void CpuManager::LoadDefaultFont()
 	// default font is loaded right in the first memory bytes
 	// default font : [0] -> [DEFAULT_FONT_SIZE - 1] 
 
-	ASSERT_MSG(m_cpu.memory != nullptr, "null Cpu::memory");
-	ASSERT_MSG((arr_size(m_cpu.memory) >= arr_size(chip8DefaultFont)), "Memory size is too low");
-
-	memcpy(m_cpu.memory, chip8DefaultFont, arr_size(chip8DefaultFont));
+	memcpy(m_cpu.memory, chip8DefaultFont, sizeof(chip8DefaultFont));
+	InvalidateInstrCache(0, sizeof(chip8DefaultFont));
 }
 
 void CpuManager::LoadHiResFont()
@@ -193,24 +370,21 @@ void CpuManager::LoadHiResFont()
 	// default font : [0] -> [DEFAULT_FONT_SIZE - 1]
 	// hi res font : [ DEFAULT_FONT_SIZE ] -> [ HI_RES_FONT_SIZE - 1 ]
 
-	constexpr const auto at = arr_size(chip8DefaultFont); 
+	constexpr const auto at = sizeof(chip8DefaultFont); 
 	
-	ASSERT_MSG(m_cpu.memory != nullptr, "null Cpu::memory");
-	ASSERT_MSG( arr_size(m_cpu.memory) >= ( at + arr_size(chip8HiResFont)), "Memory size is too low");
-	ASSERT_MSG((at + arr_size(chip8HiResFont)) < 0x200, "Hi res font is over 0x200 memory area");
+	ASSERT_MSG((at + sizeof(chip8HiResFont)) < 0x200, "Hi res font is over 0x200 memory area");
 
-	memcpy(m_cpu.memory + at, chip8HiResFont, arr_size(chip8HiResFont));
+	memcpy(m_cpu.memory + at, chip8HiResFont, sizeof(chip8HiResFont));
+	InvalidateInstrCache(at, sizeof(chip8HiResFont));
 }
 
 
 bool CpuManager::LoadRom(const char* fileName, const size_t at)
 {
 	// if the parameter 'at' is greater than m_cpu.memory array,
-	// or the m_cpu.memory ptr is null. It is the caller's error,
-	// so here's an assert for that purpose.
+	// it is the caller's error, so here's an assert for that purpose.
 
-	ASSERT_MSG(m_cpu.memory != nullptr, "null Cpu::memory");
-	ASSERT_MSG(arr_size(m_cpu.memory) > at, "parameter 'at' greater than Cpu::memory size");
+	ASSERT_MSG(GetMemorySize() > at, "parameter 'at' greater than Cpu::memory size");
 
 	Log("Loading %s", fileName);
 
@@ -234,15 +408,16 @@ bool CpuManager::LoadRom(const char* fileName, const size_t at)
 	
 	
 	// check if file size will not overflow emulated memory size
-	if ( (arr_size(m_cpu.memory) - at) <= fileSize)
+	if ( (GetMemorySize() - at) <= fileSize)
 	{
 		LogError("Error, size of \'%s\' does not fit in memory at %zu! memory size: %zu, file size: %zu", 
-                   fileName, at, arr_size(m_cpu.memory), fileSize);
+                   fileName, at, GetMemorySize(), fileSize);
 
 		return false;
 	}
 
 	const auto readSize = fread(m_cpu.memory + at, 1, fileSize, file);
+	InvalidateInstrCache(at, readSize);
 
 	if( readSize != fileSize ) 
 	{
@@ -258,6 +433,27 @@ bool CpuManager::LoadRom(const char* fileName, const size_t at)
 
 
 
+// loads a ROM already in memory, used by recompiled ROMs
+bool CpuManager::LoadRom(const uint8_t* data, const size_t size, const size_t at)
+{
+	ASSERT_MSG(GetMemorySize() > at, "parameter 'at' greater than Cpu::memory size");
+
+	if ( (GetMemorySize() - at) <= size)
+	{
+		LogError("Error, ROM size does not fit in memory at %zu! memory size: %zu, ROM size: %zu", 
+                   at, GetMemorySize(), size);
+
+		return false;
+	}
+
+	std::copy_n(data, size, m_cpu.memory + at);
+	InvalidateInstrCache(at, size);
+	return true;
+}
+
+
+
+
 void CpuManager::SetRender(iRender* render) 
 {
 	set_plugin_flag(Cpu::BAD_RENDER, render, *this);
@@ -317,7 +513,6 @@ iSound* CpuManager::SwapSound(iSound* sound)
 // local functions definitions.
 // little helpers
 inline bool __alloc_arr(const size_t bytes, void*& arr);
-inline bool __realloc_arr(const size_t bytes, void*& arr);
 
 
 inline void set_plugin_flag(Cpu::Flags flag, const iPlugin* plugin, CpuManager& man)
@@ -348,23 +543,6 @@ inline bool alloc_cpu_arr(const size_t size, T*& arr)
 
 
 
-template<class T>
-inline bool realloc_cpu_arr(const size_t size, T*& arr)
-{
-	if (arr != nullptr)
-	{
-		if(size == arr_size(arr))
-			return true;
-		
-		else
-			return __realloc_arr(sizeof(T) * size, reinterpret_cast<void*&>(arr));
-	}	
-
-	return __alloc_arr(sizeof(T) * size, reinterpret_cast<void*&>(arr));	
-}
-
-
-
 template<class T>
 inline void free_cpu_arr(T*& arr)
 {
@@ -393,11 +571,6 @@ inline bool __alloc_arr(const size_t bytes, void*& arr)
 
 
 
-inline bool __realloc_arr(const size_t bytes, void*& arr)
-{
-	arr = realloc_arr(arr, bytes);
-	return arr != nullptr;
-}
 
 
 
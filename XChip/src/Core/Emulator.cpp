@@ -18,6 +18,7 @@ along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
 
 */
 
+#include <cstring>
 #include <XChip/Core/Emulator.h>
 #include <Utix/Log.h>
 #include <Utix/ScopeExit.h>
@@ -31,7 +32,7 @@ using namespace utix;
 
 
 // local functions declarations
-inline void init_emu_timers(Timer& instrTimer, Timer& frameTimer, Timer& chDelayTimer);
+inline void init_emu_timers(Timer& instrTimer, Pacer& framePacer, Pacer& timersPacer);
 inline bool init_cpu_manager(CpuManager& m_manager);
 
 
@@ -68,7 +69,7 @@ bool Emulator::Initialize() noexcept
 			this->Dispose();
 	});
 
-	init_emu_timers(m_instrTimer, m_frameTimer, m_chDelayTimer);
+	init_emu_timers(m_instrTimer, m_framePacer, m_timersPacer);
 
 	if(init_cpu_manager(m_manager))
 	{
@@ -99,12 +100,12 @@ bool Emulator::Initialize(UniqueRender&& render, UniqueInput&& input, UniqueSoun
 	m_inputPlugin = move(input);
 	m_soundPlugin = move(sound);
 
-	init_emu_timers(m_instrTimer, m_frameTimer, m_chDelayTimer);
+	init_emu_timers(m_instrTimer, m_framePacer, m_timersPacer);
 
 	if(init_cpu_manager(m_manager))
 	{
 		// try to init all interfaces before returning something...
-		if (( InitRender() & InitInput() & InitSound()) ) 
+		if (( InitRender(m_renderPlugin.get()) & InitInput(m_inputPlugin.get()) & InitSound(m_soundPlugin.get())) ) 
 		{
 			CleanFlags();
 			m_initialized = true;
@@ -119,9 +120,45 @@ bool Emulator::Initialize(UniqueRender&& render, UniqueInput&& input, UniqueSoun
 
 
 
+// runs with the built in headless plugins, on the virtual clock and
+// unthrottled. the keys are set through GetHeadlessInput().
+bool Emulator::InitializeHeadless() noexcept
+{
+	if (!Initialize())
+		return false;
+
+	m_headlessRender.Dispose();
+	m_headlessInput.Dispose();
+	m_headlessSound.Dispose();
+
+	if (InitRender(&m_headlessRender) && InitInput(&m_headlessInput) && InitSound(&m_headlessSound))
+	{
+		CleanFlags();
+		SetVirtualClock(true);
+		SetThrottle(false);
+		return true;
+	}
+
+	Dispose();
+	return false;
+}
+
+
+
+
+
 void Emulator::Dispose() noexcept
 {
 	m_manager.Dispose();
+	m_jit.Dispose();
+	m_engine = ExecEngine::INTERPRETER;
+	m_virtualClock = false;
+	m_throttle = true;
+	m_cycles = 0;
+	m_timerPhase = 0;
+	m_framePhase = 0;
+	m_cleanFrames = 0;
+	m_refresh = true;
 	m_initialized = false;
 }
 
@@ -129,42 +166,192 @@ void Emulator::Dispose() noexcept
 
 
 
-void Emulator::HaltForNextFlag() const
+// true when the cpu is in a loop which can't change any state before
+// the next delay timer tick: a 1NNN jumping to itself, or a FX07 3X00 1NNN
+// loop waiting for the delay timer. instructions are not executed while 
+// idle, the loop resumes from the same pc with the same result.
+bool Emulator::IsIdle() const
 {
-	if (! m_manager.GetFlags(Cpu::DRAW | Cpu::INSTR))
+	const size_t pc = m_manager.GetPC();
+
+	if (pc > 0xFFF || (pc + 6) > m_manager.GetMemorySize())
+		return false;
+
+	const uint8_t* const code = m_manager.GetMemory() + pc;
+	const uint16_t jumpToPc = 0x1000 | static_cast<uint16_t>(pc);
+	const uint16_t first = code[0] << 8 | code[1];
+
+	if (first == jumpToPc)
+		return true;
+
+	const uint16_t second = code[2] << 8 | code[3];
+	const uint16_t third = code[4] << 8 | code[5];
+
+	return (first & 0xF0FF) == 0xF007 && second == (0x3000 | (first & 0x0F00))
+	    && third == jumpToPc && m_manager.GetDelayTimer() != 0;
+}
+
+
+
+
+// the pacer's sleep doesn't oversleep the os scheduler tick
+void Emulator::HaltForNextFlag()
+{
+	if (m_virtualClock)
+	{
+		if (m_throttle && !m_manager.GetFlags(Cpu::DRAW | Cpu::INSTR))
+			m_framePacer.SleepFor(m_instrTimer.GetRemain());
+	}
+	else if (! m_manager.GetFlags(Cpu::DRAW | Cpu::INSTR))
 	{
-		const auto instrRemain = m_instrTimer.GetRemain();
-		const auto frameRemain = m_frameTimer.GetRemain();
-		utix::Sleep((instrRemain < frameRemain) ? instrRemain : frameRemain);
+		// while idle only the delay timer can wake the cpu up
+		const auto instrRemain = IsIdle() ? m_timersPacer.GetRemain() : m_instrTimer.GetRemain();
+		const auto frameRemain = m_framePacer.GetRemain();
+		m_framePacer.SleepFor((instrRemain < frameRemain) ? instrRemain : frameRemain);
 	}
 }
 
 
 
-void Emulator::UpdateTimers()
+// runs one 60 hz frame on the virtual clock: the GetCpuFreq() / 60 
+// instructions left to the next tick, then ticks the delay and sound
+// timers once. the timers are driven here, don't mix it with UpdateSystems.
+FrameInfo Emulator::RunFrame()
 {
-	if (!m_manager.GetFlags(Cpu::INSTR) && m_instrTimer.Finished())
+	const size_t budget = GetCyclesToTick();
+
+	FrameInfo info;
+
+	// while idle nothing changes before the timers tick
+	info.instrs = IsIdle() ? 0 : ExecuteCycles(budget);
+	AdvanceClock(budget);
+
+	info.gfxChanged = m_manager.GetFlags(Cpu::GFX_CHANGED) != 0u;
+	info.sound = m_manager.GetSoundTimer() != 0;
+	info.exit = GetExitFlag();
+	info.waitKey = m_manager.GetFlags(Cpu::WAIT_KEY) != 0u;
+	m_manager.UnsetFlags(Cpu::GFX_CHANGED | Cpu::WAIT_KEY);
+	return info;
+}
+
+
+
+// in the virtual clock the timers and the DRAW flag follow the instructions
+// executed instead of the real time, the same ROM and input give the same
+// results anywhere. the throttle paces it to the cpu frequency.
+void Emulator::SetVirtualClock(const bool val)
+{
+	m_virtualClock = val;
+	m_timerPhase = 0;
+	m_framePhase = 0;
+	m_instrTimer.Start();
+	m_framePacer.Start();
+	m_timersPacer.Start();
+}
+
+
+
+void Emulator::AdvanceClock(const size_t cycles)
+{
+	const uint64_t freq = GetCpuFreq();
+	m_cycles += cycles;
+	m_timerPhase += cycles * 60;
+	m_framePhase += cycles * GetFps();
+
+	for (; m_timerPhase >= freq; m_timerPhase -= freq)
+		TickTimers();
+
+	if (m_framePhase >= freq)
 	{
-		m_manager.SetFlags(Cpu::INSTR);
-		m_instrTimer.Start();
+		TickFrame();
+		m_framePhase %= freq;
 	}
+}
 
-	if (!m_manager.GetFlags(Cpu::DRAW) && m_frameTimer.Finished())
-	{
+
+
+// cycles left to the next 60 hz tick of the virtual clock
+size_t Emulator::GetCyclesToTick() const
+{
+	const uint64_t freq = GetCpuFreq();
+	return static_cast<size_t>((freq - m_timerPhase + 59) / 60);
+}
+
+
+
+void Emulator::TickTimers()
+{
+	auto& cpu = m_manager.GetCpu();
+
+	if (cpu.delayTimer)
+		--cpu.delayTimer;
+
+	if (cpu.soundTimer)
+		--cpu.soundTimer;
+}
+
+
+
+
+// the frame rate only caps the draws: DRAW is set when the screen 
+// changed, or for a full draw once per second, which repairs the 
+// window after events the render didn't report.
+void Emulator::TickFrame()
+{
+	if (++m_cleanFrames >= GetFps())
+		m_refresh = true;
+
+	if (m_refresh || m_manager.GetDirtyRows() != 0)
 		m_manager.SetFlags(Cpu::DRAW);
-		m_frameTimer.Start();
-	}
+}
 
-	
 
-	if (m_chDelayTimer.Finished())
+
+
+// copies the expanded screen to the back frame and publishes it
+void Emulator::PublishFrame()
+{
+	Frame& frame = m_frames->GetBack();
+	const auto& res = m_manager.GetGfxRes();
+	memcpy(frame.pixels, m_manager.GetGfx(), sizeof(uint32_t) * res.x * res.y);
+	frame.res = res;
+	m_frames->Publish();
+}
+
+
+
+void Emulator::UpdateTimers()
+{
+	if (m_virtualClock)
 	{
-		auto& delayTimer = m_manager.GetCpu().delayTimer;
-		if (delayTimer)
-			--delayTimer;
+		if (m_manager.GetFlags(Cpu::INSTR) || (m_throttle && !m_instrTimer.Finished()))
+			return;
+
+		if (m_throttle)
+			m_instrTimer.Start();
+
+		// the idle loop is not executed but its cycles still pass,
+		// unthrottled they pass at once up to the next tick
+		if (!IsIdle())
+			m_manager.SetFlags(Cpu::INSTR);
+		else
+			AdvanceClock(m_throttle ? 1 : GetCyclesToTick());
+
+		return;
+	}
 
-		m_chDelayTimer.Start();
+	if (!m_manager.GetFlags(Cpu::INSTR) && m_instrTimer.Finished() && !IsIdle())
+	{
+		m_manager.SetFlags(Cpu::INSTR);
+		m_instrTimer.Start();
 	}
+
+	// the pacers keep their deadlines, the rates don't drift
+	if (!m_manager.GetFlags(Cpu::DRAW) && m_framePacer.Tick())
+		TickFrame();
+
+	if (m_timersPacer.Tick())
+		TickTimers();
 }
 
 
@@ -173,7 +360,9 @@ void Emulator::UpdateSystems()
 {
 	ASSERT_MSG(!m_manager.GetFlags(Cpu::BAD_RENDER), "BAD RENDER");
 	ASSERT_MSG(!m_manager.GetFlags(Cpu::BAD_INPUT),  "BAD INPUT");
-	m_manager.GetRender()->UpdateEvents();
+	if (m_manager.GetRender()->UpdateEvents())
+		m_refresh = true;
+
 	m_manager.GetInput()->UpdateKeys();
 	this->UpdateTimers();
 }
@@ -191,12 +380,45 @@ void Emulator::CleanFlags()
 
 
 
+bool Emulator::SetEngine(const ExecEngine engine)
+{
+	ASSERT_MSG(m_initialized, "Emulator is not initialized");
+
+	// the block cache is only allocated for the threaded engines
+	const bool threaded = engine == ExecEngine::THREADED || engine == ExecEngine::JIT;
+
+	if (threaded && !m_manager.SetBlockCache(0x1000, 0x4000))
+		return false;
+
+	if (engine == ExecEngine::JIT && !m_jit.IsInitialized() && !m_jit.Initialize(0x100000))
+		return false;
+
+	if (engine == ExecEngine::STATIC && m_staticCode == nullptr) {
+		LogError("No static code set for the STATIC engine");
+		return false;
+	}
+
+	m_engine = engine;
+	return true;
+}
+
+
+
+
 void Emulator::Reset()
 {
 	if(!m_manager.GetFlags(Cpu::BAD_SOUND))
-		m_soundPlugin->Stop();
+		m_manager.GetSound()->Stop();
 
 	CleanFlags();
+
+	// a reset ROM starts in the 64x32 view, like 00FE sets it
+	if (m_manager.GetGfxRes().x != 64 && !m_manager.GetFlags(Cpu::BAD_RENDER)
+	     && m_manager.GetRender()->SetResolution({64, 32}))
+	{
+		m_manager.SetGfxRes(64, 32);
+	}
+
 	m_manager.CleanGfx();
 	m_manager.CleanStack();
 	m_manager.CleanRegisters();
@@ -211,7 +433,7 @@ bool Emulator::SetRender(UniqueRender rend)
 { 
 	Log("Setting new iRender...");
 	m_renderPlugin = std::move(rend);
-	return InitRender();
+	return InitRender(m_renderPlugin.get());
 }
 
 
@@ -221,7 +443,7 @@ bool Emulator::SetInput(UniqueInput input)
 {
 	Log("Setting new iInput...");
 	m_inputPlugin = std::move(input);
-	return InitInput();
+	return InitInput(m_inputPlugin.get());
 }
 
 
@@ -231,7 +453,29 @@ bool Emulator::SetSound(UniqueSound sound)
 {
 	Log("Setting new iSound...");
 	m_soundPlugin = std::move(sound);
-	return InitSound();
+	return InitSound(m_soundPlugin.get());
+}
+
+
+
+
+// the built in plugins take the place of the render and input ones,
+// which stay owned by the emulator until swapped out
+bool Emulator::SetHeadlessRender()
+{
+	Log("Setting headless iRender...");
+	m_headlessRender.Dispose();
+	return InitRender(&m_headlessRender);
+}
+
+
+
+
+bool Emulator::SetHeadlessInput()
+{
+	Log("Setting headless iInput...");
+	m_headlessInput.Dispose();
+	return InitInput(&m_headlessInput);
 }
 
 
@@ -243,7 +487,7 @@ UniqueRender Emulator::SwapRender(UniqueRender rend)
 	{
 		Log("Swapping iRender...");
 		m_renderPlugin.Swap(rend);
-		InitRender();
+		InitRender(m_renderPlugin.get());
 		return rend;
 	}
 
@@ -261,7 +505,7 @@ UniqueInput Emulator::SwapInput(UniqueInput input)
 	{
 		Log("Swapping iInput...");
 		m_inputPlugin.Swap(input);
-		InitInput();
+		InitInput(m_inputPlugin.get());
 		return input;
 	}
 
@@ -279,7 +523,7 @@ UniqueSound Emulator::SwapSound(UniqueSound sound)
 	{
 		Log("Swapping iSound...");
 		m_soundPlugin.Swap(sound);
-		InitSound();
+		InitSound(m_soundPlugin.get());
 		return sound;
 	}
 
@@ -297,11 +541,10 @@ UniqueSound Emulator::SwapSound(UniqueSound sound)
 
 
 
-bool Emulator::InitRender()
+bool Emulator::InitRender(iRender* const rend)
 {
-	iRender* const rend = m_renderPlugin.get();
-	const auto set_render = MakeScopeExit([this]() noexcept { 
-		m_manager.SetRender(m_renderPlugin.get());
+	const auto set_render = MakeScopeExit([this, rend]() noexcept { 
+		m_manager.SetRender(rend);
 	});
 
 
@@ -312,7 +555,10 @@ bool Emulator::InitRender()
 	else if (rend->IsInitialized()) {
 		return true;
 	} 
-	else if (!rend->Initialize({512, 256}, m_manager.GetGfxRes())) {
+	// the texture is created for the max resolution, so 00FE / 00FF
+	// don't allocate while running
+	else if (!rend->Initialize({512, 256}, CpuManager::GetMaxGfxRes())
+	          || !rend->SetResolution(m_manager.GetGfxRes())) {
 		return false;
 	}
 
@@ -324,11 +570,10 @@ bool Emulator::InitRender()
 
 
 
-bool Emulator::InitInput()
+bool Emulator::InitInput(iInput* const input)
 {
-	iInput* const input = m_inputPlugin.get();
-	const auto set_input = MakeScopeExit([this]() noexcept {
-		m_manager.SetInput(m_inputPlugin.get());
+	const auto set_input = MakeScopeExit([this, input]() noexcept {
+		m_manager.SetInput(input);
 	});
 
 
@@ -352,7 +597,9 @@ bool Emulator::InitInput()
 		
 		do
 		{		
-			emulator->GetRender()->UpdateEvents();
+			if (emulator->GetRender()->UpdateEvents())
+				emulator->Refresh();
+
 			emulator->UpdateTimers();
 			
 			if (emulator->GetExitFlag())
@@ -366,6 +613,12 @@ bool Emulator::InitInput()
 
 		}while(!emulator->GetInstrFlag());
 
+		// on the virtual clock each wait is a FX0A cycle
+		if (emulator->m_virtualClock)
+		{
+			emulator->m_manager.UnsetFlags(Cpu::INSTR);
+			emulator->AdvanceClock(1);
+		}
 
 		return true;
 	});
@@ -377,11 +630,10 @@ bool Emulator::InitInput()
 
 
 
-bool Emulator::InitSound()
+bool Emulator::InitSound(iSound* const sound)
 {
-	iSound* const sound = m_soundPlugin.get();
-	const auto set_sound = MakeScopeExit([this]() noexcept {
-		m_manager.SetSound(m_soundPlugin.get());
+	const auto set_sound = MakeScopeExit([this, sound]() noexcept {
+		m_manager.SetSound(sound);
 	});
 
 	if (!sound)  {
@@ -412,13 +664,15 @@ bool Emulator::InitSound()
 
 
 // local functions definitions
-inline void init_emu_timers(Timer& instrTimer, Timer& frameTimer, Timer& chDelayTimer)
+inline void init_emu_timers(Timer& instrTimer, Pacer& framePacer, Pacer& timersPacer)
 {	
 	using namespace utix::literals;
 
 	instrTimer.SetTargetTime(380_hz);
-	frameTimer.SetTargetTime(60_hz);
-	chDelayTimer.SetTargetTime(60_hz);
+	framePacer.SetPeriod(60_hz);
+	timersPacer.SetPeriod(60_hz);
+	framePacer.Start();
+	timersPacer.Start();
 }
 
 
@@ -426,9 +680,7 @@ inline void init_emu_timers(Timer& instrTimer, Timer& frameTimer, Timer& chDelay
 inline bool init_cpu_manager(CpuManager& manager)
 {
 	// init the CPU
-	if (manager.SetMemory(0xFFFF)
-		&& manager.SetRegisters(0x10)
-		&& manager.SetStack(0x10)
+	if (manager.SetMemory(0x10000)
 		&& manager.SetGfxRes(64, 32))
 	{
 		manager.SetPC(0x200);
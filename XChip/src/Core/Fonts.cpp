@@ -27,7 +27,7 @@ namespace xchip { namespace fonts {
 
 
 
-uint8_t chip8DefaultFont[80] =
+const uint8_t chip8DefaultFont[80] =
 {
 	0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
 	0x20, 0x60, 0x20, 0x20, 0x70, // 1
@@ -49,7 +49,7 @@ uint8_t chip8DefaultFont[80] =
 
 
 
-uint8_t chip8HiResFont[160] =
+const uint8_t chip8HiResFont[160] =
 {
 	0x3c, 0x66, 0xc3, 0x81, 0x81, 0x81, 0x81, 0xc3, 0x66, 0x3c, // 0
 	0x10, 0x30, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x7e, // 1
@@ -0,0 +1,278 @@
+/*
+
+XChip - A chip8 lib and emulator.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+#include <XChip/Core/Fusion.h>
+#include <XChip/Core/Instructions.h>
+
+
+namespace xchip {
+
+
+
+const char* FusionStats::GetName(const Kind kind)
+{
+	switch (kind)
+	{
+		case SKIP_EQ_JUMP: return "3XNN 1NNN";
+		case SKIP_NE_JUMP: return "4XNN 1NNN";
+		case TIMER_SKIP_EQ: return "FX07 3XNN";
+		case TIMER_SKIP_NE: return "FX07 4XNN";
+		case ADD_SKIP_EQ: return "7XNN 3XNN";
+		case ADD_SKIP_NE: return "7XNN 4XNN";
+		case SET_I_ADD_I: return "ANNN FX1E";
+		case SET_I_DRAW: return "ANNN DXYN";
+		case SET_SET: return "6XNN 6XNN";
+		case TIMER_WAIT_EQ: return "FX07 3XNN 1NNN";
+		case TIMER_WAIT_NE: return "FX07 4XNN 1NNN";
+		case ADD_LOOP_EQ: return "7XNN 3XNN 1NNN";
+		case ADD_LOOP_NE: return "7XNN 4XNN 1NNN";
+		default: return "unknown";
+	}
+}
+
+
+
+
+namespace instructions {
+
+
+// local functions declarations
+inline DecodedInstr& decode_at(CpuManager& cpuMan, const size_t pc);
+static uint8_t classify(CpuManager& cpuMan, const size_t pc, const DecodedInstr& first);
+static uint8_t classify_pair(const DecodedInstr& first, const DecodedInstr& second);
+static size_t execute_pair(CpuManager& cpuMan, const FusionStats::Kind kind,
+                           const DecodedInstr& first, const DecodedInstr& second);
+static size_t execute_triple(CpuManager& cpuMan, const FusionStats::Kind kind, const DecodedInstr& first,
+                             const DecodedInstr& second, const DecodedInstr& third);
+
+
+// DecodedInstr::fusion values, a Kind is stored as kind + 1
+constexpr uint8_t unchecked = 0;
+constexpr uint8_t notFused = FusionStats::COUNT + 1;
+
+
+
+
+// interpreter with superinstructions: executes up to 'count'
+// instructions, running the known opcode pairs and triples as one.
+// returns how many instructions were executed.
+size_t ExecuteFused(CpuManager& cpuMan, const size_t count, FusionStats& stats)
+{
+	size_t done = 0;
+
+	while (done < count && !cpuMan.GetFlags(Cpu::EXIT))
+	{
+		const size_t pc = cpuMan.GetPC();
+		auto& first = decode_at(cpuMan, pc);
+
+		if (first.fusion != notFused && (count - done) > 1)
+		{
+			// the sequence is classified once, writes to the 
+			// next opcodes reset the first entry
+			if (first.fusion == unchecked)
+				first.fusion = classify(cpuMan, pc, first);
+
+			if (first.fusion != notFused) 
+			{
+				auto kind = static_cast<FusionStats::Kind>(first.fusion - 1);
+				const auto& second = decode_at(cpuMan, pc + 2);
+
+				if (kind >= FusionStats::TIMER_WAIT_EQ)
+				{
+					if ((count - done) > 2) {
+						++stats.fired[kind];
+						done += execute_triple(cpuMan, kind, first, second, decode_at(cpuMan, pc + 4));
+						continue;
+					}
+
+					// no budget for the jump, the same pair without it
+					kind = static_cast<FusionStats::Kind>(kind - FusionStats::TIMER_WAIT_EQ + FusionStats::TIMER_SKIP_EQ);
+				}
+
+				++stats.fired[kind];
+				done += execute_pair(cpuMan, kind, first, second);
+				continue;
+			}
+		}
+
+		cpuMan.SetInstr(first);
+		cpuMan.SetPC(pc + 2);
+		first.handler(cpuMan);
+		++done;
+	}
+
+	return done;
+}
+
+
+
+
+
+
+inline DecodedInstr& decode_at(CpuManager& cpuMan, const size_t pc)
+{
+	auto& instr = cpuMan.GetInstrCache(pc);
+
+	if (!instr.handler)
+		instr = DecodeInstruction(cpuMan.GetMemory(pc) << 8 | cpuMan.GetMemory(pc + 1));
+
+	return instr;
+}
+
+
+
+
+// the pair at pc, made a triple when the skip of a timer
+// wait or a counter loop test is followed by its jump
+static uint8_t classify(CpuManager& cpuMan, const size_t pc, const DecodedInstr& first)
+{
+	if ((pc + 3) >= cpuMan.GetMemorySize())
+		return notFused;
+
+	const uint8_t pair = classify_pair(first, decode_at(cpuMan, pc + 2));
+
+	if (pair == notFused || pair < FusionStats::TIMER_SKIP_EQ + 1 || pair > FusionStats::ADD_SKIP_NE + 1
+	     || (pc + 5) >= cpuMan.GetMemorySize() || decode_at(cpuMan, pc + 4).handler != op_1NNN)
+	{
+		return pair;
+	}
+
+	return pair - FusionStats::TIMER_SKIP_EQ + FusionStats::TIMER_WAIT_EQ;
+}
+
+
+
+
+static uint8_t classify_pair(const DecodedInstr& first, const DecodedInstr& second)
+{
+	const auto head = first.handler;
+	const auto tail = second.handler;
+	FusionStats::Kind kind;
+
+	if (head == op_3XNN && tail == op_1NNN) kind = FusionStats::SKIP_EQ_JUMP;
+	else if (head == op_4XNN && tail == op_1NNN) kind = FusionStats::SKIP_NE_JUMP;
+	else if (head == op_FX07 && tail == op_3XNN) kind = FusionStats::TIMER_SKIP_EQ;
+	else if (head == op_FX07 && tail == op_4XNN) kind = FusionStats::TIMER_SKIP_NE;
+	else if (head == op_7XNN && tail == op_3XNN) kind = FusionStats::ADD_SKIP_EQ;
+	else if (head == op_7XNN && tail == op_4XNN) kind = FusionStats::ADD_SKIP_NE;
+	else if (head == op_ANNN && tail == op_FX1E) kind = FusionStats::SET_I_ADD_I;
+	else if (head == op_ANNN && (tail == op_DXYN || tail == op_DXYN_ex)) kind = FusionStats::SET_I_DRAW;
+	else if (head == op_6XNN && tail == op_6XNN) kind = FusionStats::SET_SET;
+	else return notFused;
+
+	return kind + 1;
+}
+
+
+
+
+// runs the pair. returns the number of instructions executed:
+// 1 if the first one skipped the second, otherwise 2.
+// pc, I, VF and the opcode end the same as running both handlers.
+static size_t execute_pair(CpuManager& cpuMan, const FusionStats::Kind kind,
+                           const DecodedInstr& first, const DecodedInstr& second)
+{
+	const size_t pc = cpuMan.GetPC();
+	uint8_t* const v = cpuMan.GetRegisters();
+	size_t next = pc + 4;
+
+	switch (kind)
+	{
+		case FusionStats::SKIP_EQ_JUMP:
+		case FusionStats::SKIP_NE_JUMP:
+			if ((v[first.x] == first.nn) == (kind == FusionStats::SKIP_EQ_JUMP)) {
+				cpuMan.SetInstr(first);
+				cpuMan.SetPC(pc + 4);
+				return 1;
+			}
+			next = second.nnn;
+			break;
+
+		case FusionStats::TIMER_SKIP_EQ:
+		case FusionStats::TIMER_SKIP_NE:
+			v[first.x] = cpuMan.GetDelayTimer();
+			if ((v[second.x] == second.nn) == (kind == FusionStats::TIMER_SKIP_EQ))
+				next += 2;
+			break;
+
+		case FusionStats::ADD_SKIP_EQ:
+		case FusionStats::ADD_SKIP_NE:
+			v[first.x] += first.nn;
+			if ((v[second.x] == second.nn) == (kind == FusionStats::ADD_SKIP_EQ))
+				next += 2;
+			break;
+
+		case FusionStats::SET_I_ADD_I:
+			cpuMan.SetIndexRegister(first.nnn + v[second.x]);
+			break;
+
+		case FusionStats::SET_I_DRAW:
+			cpuMan.SetIndexRegister(first.nnn);
+			cpuMan.SetInstr(second);
+			cpuMan.SetPC(next);
+			second.handler(cpuMan);
+			return 2;
+
+		case FusionStats::SET_SET:
+			v[first.x] = first.nn;
+			v[second.x] = second.nn;
+			break;
+
+		default: break;
+	}
+
+	cpuMan.SetInstr(second);
+	cpuMan.SetPC(next);
+	return 2;
+}
+
+
+
+
+
+// runs a FX07 or 7XNN, 3XNN or 4XNN, 1NNN loop tail. returns 2 
+// when the skip jumped over the 1NNN, otherwise 3.
+static size_t execute_triple(CpuManager& cpuMan, const FusionStats::Kind kind, const DecodedInstr& first,
+                             const DecodedInstr& second, const DecodedInstr& third)
+{
+	const size_t pc = cpuMan.GetPC();
+	uint8_t* const v = cpuMan.GetRegisters();
+
+	if (kind == FusionStats::TIMER_WAIT_EQ || kind == FusionStats::TIMER_WAIT_NE)
+		v[first.x] = cpuMan.GetDelayTimer();
+	else
+		v[first.x] += first.nn;
+
+	if ((v[second.x] == second.nn) == (kind == FusionStats::TIMER_WAIT_EQ || kind == FusionStats::ADD_LOOP_EQ)) {
+		cpuMan.SetInstr(second);
+		cpuMan.SetPC(pc + 6);
+		return 2;
+	}
+
+	cpuMan.SetInstr(third);
+	cpuMan.SetPC(third.nnn);
+	return 3;
+}
+
+
+
+
+
+}}
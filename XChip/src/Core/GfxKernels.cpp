@@ -0,0 +1,389 @@
+/*
+
+XChip - A chip8 lib and emulator.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+#include <algorithm>
+#include <XChip/Core/GfxKernels.h>
+
+// SSE2 and AVX2 variants are built with target attributes
+// and selected at runtime, no special compiler flags needed.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define XCHIP_GFX_X86
+#include <immintrin.h>
+#endif
+
+
+namespace xchip {
+
+
+
+// local functions declarations
+static void scalar_clear(uint64_t* plane, const int rows);
+static void scalar_scroll_right(uint64_t* plane, const int rows, const int width);
+static void scalar_scroll_left(uint64_t* plane, const int rows, const int width);
+static void scalar_scroll_down(uint64_t* plane, const int rows, const int lines);
+static bool scalar_xor_sprite(uint64_t* plane, const int rows, const uint64_t* sprite, const int y, const int height);
+static bool scalar_compare(const uint64_t* planeA, const uint64_t* planeB, const int rows);
+static void scalar_expand(const uint64_t* plane, uint32_t* gfx, const int rows, const int width);
+
+#if defined(XCHIP_GFX_X86)
+static void sse2_clear(uint64_t* plane, const int rows);
+static void sse2_scroll_right(uint64_t* plane, const int rows, const int width);
+static void sse2_scroll_left(uint64_t* plane, const int rows, const int width);
+static bool sse2_xor_sprite(uint64_t* plane, const int rows, const uint64_t* sprite, const int y, const int height);
+static bool sse2_compare(const uint64_t* planeA, const uint64_t* planeB, const int rows);
+static void sse2_expand(const uint64_t* plane, uint32_t* gfx, const int rows, const int width);
+static void avx2_clear(uint64_t* plane, const int rows);
+static void avx2_scroll_right(uint64_t* plane, const int rows, const int width);
+static void avx2_scroll_left(uint64_t* plane, const int rows, const int width);
+static bool avx2_compare(const uint64_t* planeA, const uint64_t* planeB, const int rows);
+static void avx2_expand(const uint64_t* plane, uint32_t* gfx, const int rows, const int width);
+#endif
+
+
+static const GfxKernels scalarKernels =
+{
+	scalar_clear, scalar_scroll_right, scalar_scroll_left, scalar_scroll_down,
+	scalar_xor_sprite, scalar_compare, scalar_expand, GfxKernels::SCALAR, "scalar"
+};
+
+#if defined(XCHIP_GFX_X86)
+// the vertical scroll is a memmove, libc is already vectorized
+static const GfxKernels sse2Kernels =
+{
+	sse2_clear, sse2_scroll_right, sse2_scroll_left, scalar_scroll_down,
+	sse2_xor_sprite, sse2_compare, sse2_expand, GfxKernels::SSE2, "sse2"
+};
+
+// one row is 128 bits, AVX2 works on 2 rows. sprites wrap
+// row by row, they stay with the SSE2 version
+static const GfxKernels avx2Kernels =
+{
+	avx2_clear, avx2_scroll_right, avx2_scroll_left, scalar_scroll_down,
+	sse2_xor_sprite, avx2_compare, avx2_expand, GfxKernels::AVX2, "avx2"
+};
+#endif
+
+
+
+
+const GfxKernels* FindGfxKernels(const GfxKernels::Level level)
+{
+	switch (level)
+	{
+		case GfxKernels::SCALAR: return &scalarKernels;
+#if defined(XCHIP_GFX_X86)
+		case GfxKernels::SSE2: return __builtin_cpu_supports("sse2") ? &sse2Kernels : nullptr;
+		case GfxKernels::AVX2: return __builtin_cpu_supports("avx2") ? &avx2Kernels : nullptr;
+#endif
+		default: return nullptr;
+	}
+}
+
+
+
+const GfxKernels& GetGfxKernels()
+{
+	static const GfxKernels* const best = []() {
+		const GfxKernels* kernels = FindGfxKernels(GfxKernels::AVX2);
+		if (kernels == nullptr)
+			kernels = FindGfxKernels(GfxKernels::SSE2);
+		return kernels != nullptr ? kernels : &scalarKernels;
+	}();
+
+	return *best;
+}
+
+
+
+
+
+
+static void scalar_clear(uint64_t* plane, const int rows)
+{
+	std::fill_n(plane, rows * 2, 0);
+}
+
+
+// 4 pixels, lo-res rows only use the first word
+static void scalar_scroll_right(uint64_t* plane, const int rows, const int width)
+{
+	for (int y = 0; y < rows; ++y, plane += 2) {
+		if (width > 64)
+			plane[1] = (plane[1] >> 4) | (plane[0] << 60);
+		plane[0] >>= 4;
+	}
+}
+
+
+static void scalar_scroll_left(uint64_t* plane, const int rows, const int)
+{
+	for (int y = 0; y < rows; ++y, plane += 2) {
+		plane[0] = (plane[0] << 4) | (plane[1] >> 60);
+		plane[1] <<= 4;
+	}
+}
+
+
+static void scalar_scroll_down(uint64_t* plane, const int rows, const int lines)
+{
+	std::copy_backward(plane, plane + (rows - lines) * 2, plane + rows * 2);
+	std::fill_n(plane, lines * 2, 0);
+}
+
+
+static bool scalar_xor_sprite(uint64_t* plane, const int rows, const uint64_t* sprite, const int y, const int height)
+{
+	uint64_t erased = 0;
+
+	for (int i = 0; i < height; ++i, sprite += 2) {
+		uint64_t* const row = plane + ((y + i) & (rows - 1)) * 2;
+		erased |= (row[0] & sprite[0]) | (row[1] & sprite[1]);
+		row[0] ^= sprite[0];
+		row[1] ^= sprite[1];
+	}
+
+	return erased != 0;
+}
+
+
+static bool scalar_compare(const uint64_t* planeA, const uint64_t* planeB, const int rows)
+{
+	return std::equal(planeA, planeA + rows * 2, planeB);
+}
+
+
+static void scalar_expand(const uint64_t* plane, uint32_t* gfx, const int rows, const int width)
+{
+	for (int y = 0; y < rows; ++y, plane += 2, gfx += width) {
+		for (int x = 0; x < width; ++x)
+			gfx[x] = ((plane[x >> 6] >> (63 - (x & 63))) & 1) ? ~0u : 0u;
+	}
+}
+
+
+
+
+
+
+#if defined(XCHIP_GFX_X86)
+
+// one row per register: word 0 in the low lane
+
+__attribute__((target("sse2")))
+static void sse2_clear(uint64_t* plane, const int rows)
+{
+	const __m128i zero = _mm_setzero_si128();
+	for (int y = 0; y < rows; ++y)
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(plane) + y, zero);
+}
+
+
+__attribute__((target("sse2")))
+static void sse2_scroll_right(uint64_t* plane, const int rows, const int width)
+{
+	const __m128i mask = width > 64 ? _mm_set1_epi32(-1) : _mm_set_epi64x(0, -1);
+	__m128i* const rowsPtr = reinterpret_cast<__m128i*>(plane);
+
+	for (int y = 0; y < rows; ++y) {
+		const __m128i row = _mm_loadu_si128(rowsPtr + y);
+		const __m128i carry = _mm_slli_si128(_mm_slli_epi64(row, 60), 8);
+		_mm_storeu_si128(rowsPtr + y, _mm_and_si128(_mm_or_si128(_mm_srli_epi64(row, 4), carry), mask));
+	}
+}
+
+
+__attribute__((target("sse2")))
+static void sse2_scroll_left(uint64_t* plane, const int rows, const int)
+{
+	__m128i* const rowsPtr = reinterpret_cast<__m128i*>(plane);
+
+	for (int y = 0; y < rows; ++y) {
+		const __m128i row = _mm_loadu_si128(rowsPtr + y);
+		const __m128i carry = _mm_srli_si128(_mm_srli_epi64(row, 60), 8);
+		_mm_storeu_si128(rowsPtr + y, _mm_or_si128(_mm_slli_epi64(row, 4), carry));
+	}
+}
+
+
+__attribute__((target("sse2")))
+static bool sse2_xor_sprite(uint64_t* plane, const int rows, const uint64_t* sprite, const int y, const int height)
+{
+	__m128i* const rowsPtr = reinterpret_cast<__m128i*>(plane);
+	const __m128i* const spritePtr = reinterpret_cast<const __m128i*>(sprite);
+	__m128i erased = _mm_setzero_si128();
+
+	for (int i = 0; i < height; ++i) {
+		__m128i* const dest = rowsPtr + ((y + i) & (rows - 1));
+		const __m128i row = _mm_loadu_si128(dest);
+		const __m128i bits = _mm_loadu_si128(spritePtr + i);
+		erased = _mm_or_si128(erased, _mm_and_si128(row, bits));
+		_mm_storeu_si128(dest, _mm_xor_si128(row, bits));
+	}
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(erased, _mm_setzero_si128())) != 0xFFFF;
+}
+
+
+__attribute__((target("sse2")))
+static bool sse2_compare(const uint64_t* planeA, const uint64_t* planeB, const int rows)
+{
+	const __m128i* const a = reinterpret_cast<const __m128i*>(planeA);
+	const __m128i* const b = reinterpret_cast<const __m128i*>(planeB);
+	const __m128i zero = _mm_setzero_si128();
+	int y = 0;
+
+	// 4 rows per step, stops on the first different block
+	for (; (y + 4) <= rows; y += 4) {
+		const __m128i diff0 = _mm_or_si128(_mm_xor_si128(_mm_loadu_si128(a + y), _mm_loadu_si128(b + y)),
+			_mm_xor_si128(_mm_loadu_si128(a + y + 1), _mm_loadu_si128(b + y + 1)));
+		const __m128i diff1 = _mm_or_si128(_mm_xor_si128(_mm_loadu_si128(a + y + 2), _mm_loadu_si128(b + y + 2)),
+			_mm_xor_si128(_mm_loadu_si128(a + y + 3), _mm_loadu_si128(b + y + 3)));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(diff0, diff1), zero)) != 0xFFFF)
+			return false;
+	}
+
+	for (; y < rows; ++y) {
+		const __m128i diff = _mm_xor_si128(_mm_loadu_si128(a + y), _mm_loadu_si128(b + y));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero)) != 0xFFFF)
+			return false;
+	}
+
+	return true;
+}
+
+
+// each 8 pixels byte becomes 2 x 4 uint32 masks
+__attribute__((target("sse2")))
+static void sse2_expand(const uint64_t* plane, uint32_t* gfx, const int rows, const int width)
+{
+	const __m128i highBits = _mm_set_epi32(0x10, 0x20, 0x40, 0x80);
+	const __m128i lowBits = _mm_set_epi32(0x1, 0x2, 0x4, 0x8);
+
+	for (int y = 0; y < rows; ++y, plane += 2) {
+		for (int x = 0; x < width; x += 8) {
+			const int byte = (plane[x >> 6] >> (56 - (x & 63))) & 0xff;
+			const __m128i pixels = _mm_set1_epi32(byte);
+			__m128i* const out = reinterpret_cast<__m128i*>(gfx);
+			_mm_storeu_si128(out, _mm_cmpeq_epi32(_mm_and_si128(pixels, highBits), highBits));
+			_mm_storeu_si128(out + 1, _mm_cmpeq_epi32(_mm_and_si128(pixels, lowBits), lowBits));
+			gfx += 8;
+		}
+	}
+}
+
+
+
+
+// two rows per register, odd row counts end with the SSE2 version
+
+__attribute__((target("avx2")))
+static void avx2_clear(uint64_t* plane, const int rows)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	int y = 0;
+
+	for (; (y + 2) <= rows; y += 2)
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(plane + y * 2), zero);
+
+	sse2_clear(plane + y * 2, rows - y);
+}
+
+
+__attribute__((target("avx2")))
+static void avx2_scroll_right(uint64_t* plane, const int rows, const int width)
+{
+	const __m256i mask = width > 64 ? _mm256_set1_epi32(-1) : _mm256_set_epi64x(0, -1, 0, -1);
+	int y = 0;
+
+	for (; (y + 2) <= rows; y += 2) {
+		__m256i* const dest = reinterpret_cast<__m256i*>(plane + y * 2);
+		const __m256i row = _mm256_loadu_si256(dest);
+		const __m256i carry = _mm256_slli_si256(_mm256_slli_epi64(row, 60), 8);
+		_mm256_storeu_si256(dest, _mm256_and_si256(_mm256_or_si256(_mm256_srli_epi64(row, 4), carry), mask));
+	}
+
+	sse2_scroll_right(plane + y * 2, rows - y, width);
+}
+
+
+__attribute__((target("avx2")))
+static void avx2_scroll_left(uint64_t* plane, const int rows, const int width)
+{
+	int y = 0;
+
+	for (; (y + 2) <= rows; y += 2) {
+		__m256i* const dest = reinterpret_cast<__m256i*>(plane + y * 2);
+		const __m256i row = _mm256_loadu_si256(dest);
+		const __m256i carry = _mm256_srli_si256(_mm256_srli_epi64(row, 60), 8);
+		_mm256_storeu_si256(dest, _mm256_or_si256(_mm256_slli_epi64(row, 4), carry));
+	}
+
+	sse2_scroll_left(plane + y * 2, rows - y, width);
+}
+
+
+__attribute__((target("avx2")))
+static bool avx2_compare(const uint64_t* planeA, const uint64_t* planeB, const int rows)
+{
+	const __m256i* const a = reinterpret_cast<const __m256i*>(planeA);
+	const __m256i* const b = reinterpret_cast<const __m256i*>(planeB);
+	int y = 0;
+
+	// 8 rows per step, stops on the first different block
+	for (; (y + 8) <= rows; y += 8) {
+		const int i = y / 2;
+		const __m256i diff0 = _mm256_or_si256(_mm256_xor_si256(_mm256_loadu_si256(a + i), _mm256_loadu_si256(b + i)),
+			_mm256_xor_si256(_mm256_loadu_si256(a + i + 1), _mm256_loadu_si256(b + i + 1)));
+		const __m256i diff1 = _mm256_or_si256(_mm256_xor_si256(_mm256_loadu_si256(a + i + 2), _mm256_loadu_si256(b + i + 2)),
+			_mm256_xor_si256(_mm256_loadu_si256(a + i + 3), _mm256_loadu_si256(b + i + 3)));
+		const __m256i diff = _mm256_or_si256(diff0, diff1);
+		if (!_mm256_testz_si256(diff, diff))
+			return false;
+	}
+
+	return sse2_compare(planeA + y * 2, planeB + y * 2, rows - y);
+}
+
+
+// each 8 pixels byte becomes 8 uint32 masks
+__attribute__((target("avx2")))
+static void avx2_expand(const uint64_t* plane, uint32_t* gfx, const int rows, const int width)
+{
+	const __m256i bits = _mm256_set_epi32(0x1, 0x2, 0x4, 0x8, 0x10, 0x20, 0x40, 0x80);
+
+	for (int y = 0; y < rows; ++y, plane += 2) {
+		for (int x = 0; x < width; x += 8) {
+			const int byte = (plane[x >> 6] >> (56 - (x & 63))) & 0xff;
+			const __m256i pixels = _mm256_set1_epi32(byte);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(gfx), _mm256_cmpeq_epi32(_mm256_and_si256(pixels, bits), bits));
+			gfx += 8;
+		}
+	}
+}
+
+
+#endif
+
+
+
+
+
+
+}
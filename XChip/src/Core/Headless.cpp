@@ -0,0 +1,255 @@
+/*
+
+XChip - A chip8 lib and emulator.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+#include <Utix/Log.h>
+#include <XChip/Core/Headless.h>
+
+
+
+
+namespace xchip {
+
+using namespace utix;
+
+// local functions declarations
+static Key first_key(const uint32_t keys) noexcept;
+
+
+
+
+bool HeadlessRender::Initialize(const Vec2i& winSize, const Vec2i& resolution) noexcept
+{
+	m_winSize = winSize;
+	m_res = resolution;
+	m_maxRes = resolution;
+	m_frames = 0;
+	m_initialized = true;
+	return true;
+}
+
+
+void HeadlessRender::Dispose() noexcept
+{
+	m_buffer = nullptr;
+	m_initialized = false;
+}
+
+
+bool HeadlessRender::IsInitialized() const noexcept { return m_initialized; }
+const char* HeadlessRender::GetPluginName() const noexcept { return "HeadlessRender"; }
+const char* HeadlessRender::GetPluginVersion() const noexcept { return "1.0"; }
+PluginDeleter HeadlessRender::GetPluginDeleter() const noexcept { return nullptr; }
+const char* HeadlessRender::GetWindowName() const noexcept { return ""; }
+const uint32_t* HeadlessRender::GetBuffer() const noexcept { return m_buffer; }
+Vec2i HeadlessRender::GetResolution() const noexcept { return m_res; }
+Vec2i HeadlessRender::GetWindowSize() const noexcept { return m_winSize; }
+Vec2i HeadlessRender::GetWindowPosition() const noexcept { return m_winPos; }
+Color HeadlessRender::GetDrawColor() const noexcept { return m_color; }
+Color HeadlessRender::GetBackgroundColor() const noexcept { return m_bkgColor; }
+bool HeadlessRender::UpdateEvents() noexcept { return false; }
+void HeadlessRender::SetWindowName(const char*) noexcept {}
+void HeadlessRender::SetWindowSize(const Vec2i& size) noexcept { m_winSize = size; }
+void HeadlessRender::SetWindowPosition(const Vec2i& pos) noexcept { m_winPos = pos; }
+bool HeadlessRender::SetFullScreen(const bool) noexcept { return true; }
+void HeadlessRender::SetBuffer(const uint32_t* gfx) noexcept { m_buffer = gfx; }
+void HeadlessRender::DrawBuffer() noexcept { ++m_frames; }
+void HeadlessRender::HideWindow() noexcept {}
+void HeadlessRender::ShowWindow() noexcept {}
+void HeadlessRender::SetWinCloseCallback(const void*, WinCloseCallback) noexcept {}
+void HeadlessRender::SetWinResizeCallback(const void*, WinResizeCallback) noexcept {}
+
+
+bool HeadlessRender::SetResolution(const Vec2i& res) noexcept
+{
+	// like SdlRender, only views of the resolution given to Initialize
+	if (res.x > m_maxRes.x || res.y > m_maxRes.y)
+	{
+		LogError("HeadlessRender: resolution over the initialized one");
+		return false;
+	}
+
+	m_res = res;
+	return true;
+}
+
+
+bool HeadlessRender::SetDrawColor(const Color& color) noexcept
+{
+	m_color = color;
+	return true;
+}
+
+
+bool HeadlessRender::SetBackgroundColor(const Color& color) noexcept
+{
+	m_bkgColor = color;
+	return true;
+}
+
+
+
+
+
+
+
+
+bool HeadlessInput::Initialize() noexcept
+{
+	m_keys = 0;
+	m_initialized = true;
+	return true;
+}
+
+
+void HeadlessInput::Dispose() noexcept
+{
+	m_initialized = false;
+}
+
+
+bool HeadlessInput::IsInitialized() const noexcept { return m_initialized; }
+const char* HeadlessInput::GetPluginName() const noexcept { return "HeadlessInput"; }
+const char* HeadlessInput::GetPluginVersion() const noexcept { return "1.0"; }
+PluginDeleter HeadlessInput::GetPluginDeleter() const noexcept { return nullptr; }
+
+
+bool HeadlessInput::IsKeyPressed(const Key key) const noexcept
+{
+	// EX9E / EXA1 pass any VX as the key
+	return key < Key::NO_KEY_PRESSED && (m_keys & (1u << static_cast<uint32_t>(key)));
+}
+
+
+// same returns as SdlInput: true when RESET or ESCAPE were handled
+bool HeadlessInput::UpdateKeys() noexcept
+{
+	if (m_source != nullptr)
+		m_keys = m_source(m_sourceArg);
+
+	if (IsKeyPressed(Key::RESET))
+	{
+		if (m_resetClbk)
+			m_resetClbk(m_resetClbkArg);
+
+		return true;
+	}
+	else if (IsKeyPressed(Key::ESCAPE))
+	{
+		if (m_escapeClbk)
+			m_escapeClbk(m_escapeClbkArg);
+
+		return true;
+	}
+
+	return false;
+}
+
+
+// without a key source nothing can press a key while waiting, so it 
+// returns NO_KEY_PRESSED at once and FX0A runs again in the next cycle.
+// as in SdlInput a handled RESET doesn't end the wait, only the wait
+// callback gives it up
+Key HeadlessInput::WaitKeyPress() noexcept
+{
+	Key key = first_key(m_keys);
+
+	if (m_source == nullptr || m_waitClbk == nullptr)
+		return key;
+
+	while (key == Key::NO_KEY_PRESSED && m_waitClbk(m_waitClbkArg))
+	{
+		if (!UpdateKeys())
+			key = first_key(m_keys);
+	}
+
+	return key;
+}
+
+
+void HeadlessInput::SetWaitKeyCallback(const void* arg, WaitKeyCallback callback) noexcept
+{
+	m_waitClbkArg = arg;
+	m_waitClbk = callback;
+}
+
+
+void HeadlessInput::SetResetKeyCallback(const void* arg, ResetKeyCallback callback) noexcept
+{
+	m_resetClbkArg = arg;
+	m_resetClbk = callback;
+}
+
+
+void HeadlessInput::SetEscapeKeyCallback(const void* arg, EscapeKeyCallback callback) noexcept
+{
+	m_escapeClbkArg = arg;
+	m_escapeClbk = callback;
+}
+
+
+
+
+
+
+
+
+bool HeadlessSound::Initialize() noexcept
+{
+	m_initialized = true;
+	return true;
+}
+
+
+void HeadlessSound::Dispose() noexcept
+{
+	m_initialized = false;
+}
+
+
+bool HeadlessSound::IsInitialized() const noexcept { return m_initialized; }
+const char* HeadlessSound::GetPluginName() const noexcept { return "HeadlessSound"; }
+const char* HeadlessSound::GetPluginVersion() const noexcept { return "1.0"; }
+PluginDeleter HeadlessSound::GetPluginDeleter() const noexcept { return nullptr; }
+bool HeadlessSound::IsPlaying() const noexcept { return false; }
+float HeadlessSound::GetCountdownFreq() const noexcept { return m_countdownFreq; }
+float HeadlessSound::GetSoundFreq() const noexcept { return m_soundFreq; }
+void HeadlessSound::SetCountdownFreq(const float hz) noexcept { m_countdownFreq = hz; }
+void HeadlessSound::SetSoundFreq(const float hz) noexcept { m_soundFreq = hz; }
+void HeadlessSound::Play(const uint8_t) noexcept {}
+void HeadlessSound::Stop() noexcept {}
+
+
+
+
+static Key first_key(const uint32_t keys) noexcept
+{
+	for (uint32_t key = 0; key < 16; ++key)
+	{
+		if (keys & (1u << key))
+			return static_cast<Key>(key);
+	}
+
+	return Key::NO_KEY_PRESSED;
+}
+
+
+
+
+}
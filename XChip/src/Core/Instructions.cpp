@@ -18,6 +18,7 @@ along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
 
 
 #include <algorithm>
+#include <utility>
 #include <XChip/Plugins.h>
 #include <XChip/Core.h>
 
@@ -29,22 +30,24 @@ using namespace utix;
 
 
 #define OPMSN ((cpuMan.GetOpcode(0xf000) >> 12)) // opcode most significant nibble
-#define X   ((cpuMan.GetOpcode(0x0f00) >> 8))
-#define Y   ((cpuMan.GetOpcode(0x00f0) >> 4))
+#define X   (cpuMan.GetX())
+#define Y   (cpuMan.GetY())
 #define N   (cpuMan.GetOpcode(0x000f))
-#define NN  (cpuMan.GetOpcode(0x00ff))
-#define NNN (cpuMan.GetOpcode(0x0fff))
+#define NN  (cpuMan.GetNN())
+#define NNN (cpuMan.GetNNN())
 #define VF  (cpuMan.GetRegisters(0xF))
 #define VX  (cpuMan.GetRegisters(X))
 #define VY  (cpuMan.GetRegisters(Y))
 
 
-InstrTable instrTable[16] =
+// the tables are never written, the DXYN mode is
+// read from each CpuManager flags by op_DXYN_ex
+const InstrTable instrTable[16] =
 {
 	op_0xxx, op_1NNN, op_2NNN, op_3XNN,
 	op_4XNN, op_5XY0, op_6XNN, op_7XNN,
 	op_8XYx, op_9XY0, op_ANNN, op_BNNN,
-	op_CXNN, op_DXYN, op_EXxx, op_FXxx
+	op_CXNN, op_DXYN_ex, op_EXxx, op_FXxx
 };
 
 
@@ -57,19 +60,359 @@ void UnknownOpcode(CpuManager& cpuMan)
 }
 
 
+// local functions declarations
+static InstrBlock* translate_block(CpuManager& cpuMan, const size_t pc);
+static size_t run_block(CpuManager& cpuMan, InstrBlock& block, const size_t first, const size_t count);
+static void rotate_row(uint64_t* const out, const int width, const int x, const uint16_t bits);
+
+
 
 
 void ExecuteInstruction(CpuManager& cpuMan)
 {
-	// decode the next opcode 
-	cpuMan.FetchOpcode();
+	const size_t pc = cpuMan.GetPC();
+
+#if defined(XCHIP_OPCODE_TABLE)
+	// a single indirect call on the raw opcode
+	const uint16_t opcode = cpuMan.GetMemory(pc) << 8 | cpuMan.GetMemory(pc + 1);
+	cpuMan.SetOpcode(opcode);
+	cpuMan.SetPC(pc + 2);
+	opcodeTable[opcode](cpuMan);
+#else
+	auto& instr = cpuMan.GetInstrCache(pc);
+
+	// decode the opcode only the first time its address is executed.
+	// writes to memory invalidate the entries they overlap.
+	if (!instr.handler)
+		instr = DecodeInstruction(cpuMan.GetMemory(pc) << 8 | cpuMan.GetMemory(pc + 1));
+
+	cpuMan.SetInstr(instr);
+	cpuMan.SetPC(pc + 2);
+	instr.handler(cpuMan);
+#endif
+}
+
+
+
+
+// threaded code engine: executes up to 'count' instructions 
+// running translated blocks back to back. returns how many
+// instructions were executed. with a JitArena, hot blocks
+// are compiled and run as native code. a block left before its
+// end is resumed by the next call, so small counts don't
+// translate a new block at each pc.
+size_t ExecuteBlocks(CpuManager& cpuMan, const size_t count, JitArena* jit)
+{
+	InstrBlock* block = cpuMan.GetResumeBlock();
+	size_t done = 0;
+
+	if (block != nullptr)
+	{
+		const size_t pc = cpuMan.GetPC();
+		cpuMan.SetResumeBlock(nullptr);
+
+		// pc may have moved since, the code is the same while the block is valid
+		if (block->valid && pc > block->begin && pc < block->end && ((pc - block->begin) & 1) == 0)
+			done = run_block(cpuMan, *block, (pc - block->begin) / 2, count);
+		else
+			block = nullptr;
+	}
+
+	while (done < count && !cpuMan.GetFlags(Cpu::EXIT))
+	{
+		const size_t pc = cpuMan.GetPC();
+		InstrBlock* next = nullptr;
+
+		// try the blocks chained to the last one before the map
+		if (block != nullptr)
+		{
+			for (auto* const link : block->next)
+			{
+				if (link != nullptr && link->valid && link->begin == pc) {
+					next = link;
+					break;
+				}
+			}
+		}
+
+		if (next == nullptr)
+		{
+			next = cpuMan.GetBlock(pc);
+
+			if (next == nullptr && (next = translate_block(cpuMan, pc)) == nullptr) 
+			{
+				// nothing to translate at pc ( end of memory )
+				ExecuteInstruction(cpuMan);
+				block = nullptr;
+				++done;
+				continue;
+			}
+
+			if (block != nullptr && block->valid)
+				block->next[block->next[0] != nullptr] = next;
+		}
+
+		block = next;
+
+		if (block->native != nullptr && block->size <= (count - done))
+		{
+			block->native(cpuMan, cpuMan.GetCpu());
+			done += block->size;
+			continue;
+		}
+
+		const size_t size = run_block(cpuMan, *block, 0, count - done);
+		done += size;
+
+		// only whole runs count, partial ones could not run the native code
+		if (jit != nullptr && size == block->size && ++block->hits == JitArena::GetHotThreshold() && block->valid)
+		{
+			// out of native code space: start over, 
+			// no block may point to the old code
+			if (!jit->Compile(*block)) {
+				jit->Clean();
+				cpuMan.CleanBlockCache();
+				block = nullptr;
+			}
+		}
+	}
+
+	return done;
+}
+
+
+
+
+// tight loop: executes up to 'count' instructions in one call with
+// computed goto dispatch. pc, I and sp live in locals and are written
+// back when leaving the loop, or before calling a handler for the
+// instructions which are not inlined here. returns how many
+// instructions were executed.
+#if defined(__GNUC__)
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+size_t ExecuteLoop(CpuManager& cpuMan, const size_t count)
+{
+	static const void* const primary[16] =
+	{
+		&&l_0xxx, &&l_1NNN, &&l_2NNN, &&l_3XNN,
+		&&l_4XNN, &&l_5XY0, &&l_6XNN, &&l_7XNN,
+		&&l_8XYx, &&l_9XY0, &&l_ANNN, &&l_BNNN,
+		&&l_call, &&l_call, &&l_call, &&l_FXxx
+	};
+
+	static const void* const sub8XYx[16] =
+	{
+		&&l_8XY0, &&l_8XY1, &&l_8XY2, &&l_8XY3,
+		&&l_8XY4, &&l_8XY5, &&l_8XY6, &&l_8XY7,
+		&&l_call, &&l_call, &&l_call, &&l_call,
+		&&l_call, &&l_call, &&l_8XYE, &&l_call
+	};
+
+	const uint8_t* const memory = cpuMan.GetMemory();
+	uint8_t* const v = cpuMan.GetRegisters();
+	uint16_t* const stack = cpuMan.GetStack();
+	size_t pc = cpuMan.GetPC();
+	size_t I = cpuMan.GetIndexRegister();
+	size_t sp = cpuMan.GetSP();
+	uint16_t opcode = cpuMan.GetOpcode();
+	size_t done = 0;
+
+	#define LOOP_X  ((opcode & 0x0f00) >> 8)
+	#define LOOP_Y  ((opcode & 0x00f0) >> 4)
+	#define LOOP_NN (opcode & 0x00ff)
+	#define LOOP_NNN (opcode & 0x0fff)
+
+	#define LOOP_NEXT()                                         \
+		if (done == count)                                      \
+			goto l_leave;                                       \
+		++done;                                                 \
+		pc &= Cpu::ADDRESS_MASK;                                \
+		opcode = memory[pc] << 8 | memory[pc + 1];              \
+		pc += 2;                                                \
+		goto *primary[opcode >> 12]
+
+
+	if (cpuMan.GetFlags(Cpu::EXIT))
+		return 0;
+
+	LOOP_NEXT();
+
+
+l_0xxx:
+	if (opcode == 0x00EE) {
+		pc = stack[--sp & 0xF];
+		LOOP_NEXT();
+	}
+	goto l_call;
+
+l_1NNN:
+	pc = LOOP_NNN;
+	LOOP_NEXT();
+
+l_2NNN:
+	stack[sp++ & 0xF] = static_cast<uint16_t>(pc);
+	pc = LOOP_NNN;
+	LOOP_NEXT();
 
-	ASSERT_MSG(static_cast<size_t>(OPMSN) < arr_size(instrTable), "Instruction Table Overflow!");
-	
-	// send the opcode most significant nibble to the first instruction table
-	instrTable[OPMSN](cpuMan);
+l_3XNN:
+	if (v[LOOP_X] == LOOP_NN)
+		pc += 2;
+	LOOP_NEXT();
+
+l_4XNN:
+	if (v[LOOP_X] != LOOP_NN)
+		pc += 2;
+	LOOP_NEXT();
+
+l_5XY0:
+	if (v[LOOP_X] == v[LOOP_Y])
+		pc += 2;
+	LOOP_NEXT();
+
+l_6XNN:
+	v[LOOP_X] = static_cast<uint8_t>(LOOP_NN);
+	LOOP_NEXT();
+
+l_7XNN:
+	v[LOOP_X] += static_cast<uint8_t>(LOOP_NN);
+	LOOP_NEXT();
+
+l_8XYx:
+	goto *sub8XYx[opcode & 0x000f];
+
+l_8XY0:
+	v[LOOP_X] = v[LOOP_Y];
+	LOOP_NEXT();
+
+l_8XY1:
+	v[LOOP_X] |= v[LOOP_Y];
+	LOOP_NEXT();
+
+l_8XY2:
+	v[LOOP_X] &= v[LOOP_Y];
+	LOOP_NEXT();
+
+l_8XY3:
+	v[LOOP_X] ^= v[LOOP_Y];
+	LOOP_NEXT();
+
+// VX is read again after VF is set, like the handlers do
+l_8XY4:
+{
+	const uint16_t result = v[LOOP_X] + v[LOOP_Y];
+	v[0xF] = (result & 0xff00) != 0 ? 1 : 0;
+	v[LOOP_X] = (result & 0xff);
+	LOOP_NEXT();
+}
+
+l_8XY5:
+{
+	const uint8_t vy = v[LOOP_Y];
+	v[0xF] = vy > v[LOOP_X] ? 0 : 1;
+	v[LOOP_X] -= vy;
+	LOOP_NEXT();
 }
 
+l_8XY6:
+	v[0xF] = v[LOOP_X] & 0x1;
+	v[LOOP_X] >>= 1;
+	LOOP_NEXT();
+
+l_8XY7:
+{
+	const uint8_t vy = v[LOOP_Y];
+	v[0xF] = v[LOOP_X] > vy ? 0 : 1;
+	v[LOOP_X] = vy - v[LOOP_X];
+	LOOP_NEXT();
+}
+
+l_8XYE:
+	v[0xF] = ((v[LOOP_X] & 0x80) == 0x80) ? 1 : 0;
+	v[LOOP_X] = v[LOOP_X] << 1;
+	LOOP_NEXT();
+
+l_9XY0:
+	if (v[LOOP_X] != v[LOOP_Y])
+		pc += 2;
+	LOOP_NEXT();
+
+l_ANNN:
+	I = LOOP_NNN;
+	LOOP_NEXT();
+
+l_BNNN:
+	pc = LOOP_NNN + v[0];
+	LOOP_NEXT();
+
+l_FXxx:
+	switch (LOOP_NN)
+	{
+		case 0x07: v[LOOP_X] = cpuMan.GetDelayTimer(); LOOP_NEXT();
+		case 0x15: cpuMan.SetDelayTimer(v[LOOP_X]); LOOP_NEXT();
+		case 0x1E: I = (I + v[LOOP_X]) & Cpu::ADDRESS_MASK; LOOP_NEXT();
+		case 0x29: I = cpuMan.GetDefaultFontIndex() + (v[LOOP_X] * 5); LOOP_NEXT();
+		case 0x30: I = cpuMan.GetHiResFontIndex() + (v[LOOP_X] * 10); LOOP_NEXT();
+		case 0x65:
+			std::copy_n(memory + I, LOOP_X + 1, v);
+			LOOP_NEXT();
+		default: goto l_call;
+	}
+
+// everything else runs the existing handler on the written back state
+l_call:
+	cpuMan.SetPC(pc);
+	cpuMan.SetIndexRegister(I);
+	cpuMan.SetSP(sp);
+	{
+		auto& instr = cpuMan.GetInstrCache(pc - 2);
+		if (!instr.handler)
+			instr = DecodeInstruction(opcode);
+
+		cpuMan.SetInstr(instr);
+		instr.handler(cpuMan);
+	}
+	pc = cpuMan.GetPC();
+	I = cpuMan.GetIndexRegister();
+	sp = cpuMan.GetSP();
+
+	if (cpuMan.GetFlags(Cpu::EXIT))
+		goto l_leave;
+
+	LOOP_NEXT();
+
+
+l_leave:
+	cpuMan.SetPC(pc);
+	cpuMan.SetIndexRegister(I);
+	cpuMan.SetSP(sp);
+	cpuMan.SetOpcode(opcode);
+	return done;
+
+	#undef LOOP_NEXT
+	#undef LOOP_NNN
+	#undef LOOP_NN
+	#undef LOOP_Y
+	#undef LOOP_X
+}
+
+#pragma GCC diagnostic pop
+
+#else
+
+size_t ExecuteLoop(CpuManager& cpuMan, const size_t count)
+{
+	size_t done = 0;
+	for (; done < count && !cpuMan.GetFlags(Cpu::EXIT); ++done)
+		ExecuteInstruction(cpuMan);
+
+	return done;
+}
+
+#endif
+
 
 
 
@@ -78,23 +421,19 @@ void op_0xxx(CpuManager& cpuMan)
 	switch (cpuMan.GetOpcode())
 	{
 		case 0x00E0: // clear screen
-			cpuMan.CleanGfx();
+			op_00E0(cpuMan);
 			break;
 
 		case 0x00EE: // return from a subroutine ( unwind stack )
-			cpuMan.SetSP(cpuMan.GetSP() - 1);
-			cpuMan.SetPC(cpuMan.GetStack(cpuMan.GetSP()));
+			op_00EE(cpuMan);
 			break;
 
 		case 0x00FB: // 0x00FB* SuperChip: scrolls display 4 pixels right:
 		{
 			ASSERT_MSG(!cpuMan.GetFlags(Cpu::BAD_RENDER), "BAD RENDER");
 			const auto res = cpuMan.GetGfxRes();
-			for (int y = 0; y < res.y; ++y) {
-				uint32_t* const lineBeg = cpuMan.GetGfx() + res.x * y;
-				std::copy_n(lineBeg, res.x - 4, lineBeg+4);
-				std::fill_n(lineBeg, 4, 0);
-			}
+			GetGfxKernels().scrollRight(cpuMan.GetPlane(), res.y, res.x);
+			cpuMan.MarkDirtyRows(0, res.y);
 			break;
 		}
 
@@ -103,11 +442,8 @@ void op_0xxx(CpuManager& cpuMan)
 		{
 			ASSERT_MSG(!cpuMan.GetFlags(Cpu::BAD_RENDER), "BAD RENDER");
 			const auto res = cpuMan.GetGfxRes();
-			for (int y = 0; y < res.y; ++y) {
-				uint32_t* const lineBeg = cpuMan.GetGfx() + res.x * y;
-				std::copy_n(lineBeg+4, res.x-4, lineBeg);
-				std::fill_n(lineBeg + res.x-4, 4, 0); 
-			}
+			GetGfxKernels().scrollLeft(cpuMan.GetPlane(), res.y, res.x);
+			cpuMan.MarkDirtyRows(0, res.y);
 			break;
 		}
 
@@ -123,6 +459,13 @@ void op_0xxx(CpuManager& cpuMan)
 			ASSERT_MSG(!cpuMan.GetFlags(Cpu::BAD_RENDER), "BAD RENDER");
 			
 			constexpr Vec2i defaultRes(64,32);
+
+			// the flag is set even on the same view, Reset clears it
+			cpuMan.UnsetFlags(Cpu::EXTENDED_MODE);
+
+			// gfx is preallocated for the extended mode, this only changes the view
+			if (cpuMan.GetGfxRes().x == defaultRes.x)
+				break;
 		
 			if (!cpuMan.GetRender()->SetResolution(defaultRes))
 			{
@@ -131,11 +474,6 @@ void op_0xxx(CpuManager& cpuMan)
 			}
 
 			cpuMan.SetGfxRes(defaultRes);
-			cpuMan.GetRender()->SetBuffer(cpuMan.GetGfx());
-			cpuMan.UnsetFlags(Cpu::EXTENDED_MODE);
-			
-			instrTable[0xD] = &op_DXYN;
-
 			break;
 
 		}
@@ -146,6 +484,11 @@ void op_0xxx(CpuManager& cpuMan)
 			ASSERT_MSG(!cpuMan.GetFlags(Cpu::BAD_RENDER), "BAD RENDER");
 			
 			constexpr Vec2i extendedRes(128, 64);
+
+			cpuMan.SetFlags(Cpu::EXTENDED_MODE);
+
+			if (cpuMan.GetGfxRes().x == extendedRes.x)
+				break;
 		
 			if(!cpuMan.GetRender()->SetResolution( extendedRes ))
 			{
@@ -154,11 +497,6 @@ void op_0xxx(CpuManager& cpuMan)
 			}
 
 			cpuMan.SetGfxRes(extendedRes);
-			cpuMan.GetRender()->SetBuffer(cpuMan.GetGfx());
-			cpuMan.SetFlags(Cpu::EXTENDED_MODE);
-			
-			instrTable[0xD] = &op_DXYN_ex;
-
 			break;
 		}
 
@@ -169,10 +507,8 @@ void op_0xxx(CpuManager& cpuMan)
 				ASSERT_MSG(!cpuMan.GetFlags(Cpu::BAD_RENDER), "BAD RENDER");
 				// 00CN* SuperChip: Scroll display N lines down:
 				const auto res = cpuMan.GetGfxRes();
-				uint32_t* const gfx = cpuMan.GetGfx();
-				const int lines = N;
-				std::copy_n(gfx, (res.y-lines) * res.x, gfx + (lines * res.x));
-				std::fill_n(gfx, lines * res.x, 0);
+				GetGfxKernels().scrollDown(cpuMan.GetPlane(), res.y, N);
+				cpuMan.MarkDirtyRows(0, res.y);
 
 			} else {
 				UnknownOpcode(cpuMan);
@@ -185,6 +521,25 @@ void op_0xxx(CpuManager& cpuMan)
 
 
 
+// 00E0: clears the screen
+void op_00E0(CpuManager& cpuMan)
+{
+	cpuMan.CleanGfx();
+}
+
+
+
+// 00EE: returns from a subroutine ( unwind stack )
+// the stack is a ring of 16 entries, sp only wraps around
+void op_00EE(CpuManager& cpuMan)
+{
+	cpuMan.SetSP(cpuMan.GetSP() - 1);
+	cpuMan.SetPC(cpuMan.GetStack(cpuMan.GetSP() & 0xF));
+}
+
+
+
+
 // 1NNN:  jumps to address NNN
 void op_1NNN(CpuManager& cpuMan)
 {
@@ -197,7 +552,7 @@ void op_1NNN(CpuManager& cpuMan)
 // 2NNN: Calls subroutine at address NNN
 void op_2NNN(CpuManager& cpuMan)
 {
-	cpuMan.GetStack(cpuMan.GetSP()) = cpuMan.GetPC();
+	cpuMan.GetStack(cpuMan.GetSP() & 0xF) = cpuMan.GetPC();
 	cpuMan.SetSP( cpuMan.GetSP() + 1 );
 	cpuMan.SetPC( NNN );
 }
@@ -274,7 +629,41 @@ void op_BNNN(CpuManager& cpuMan)
 // CXNN: Sets VX to a bitwise operation AND ( & ) between NN and a random number
 void op_CXNN(CpuManager& cpuMan)
 {
-	VX = ((std::rand() % 0xff) & NN);
+	VX = ((cpuMan.NextRandom() % 0xff) & NN);
+}
+
+
+
+
+// rotates a sprite row ( msb first ) to x, wrapping
+// around the width, into the 2 words of a plane row.
+static void rotate_row(uint64_t* const out, const int width, const int x, const uint16_t bits)
+{
+	uint64_t hi = static_cast<uint64_t>(bits) << 48;
+	const int shift = x & 63;
+
+	if (width <= 64)
+	{
+		out[0] = (hi >> shift) | (hi << ((64 - shift) & 63));
+		out[1] = 0;
+		return;
+	}
+
+	// 128 bits rotation
+	uint64_t lo = 0;
+
+	if (x & 64)
+		std::swap(hi, lo);
+
+	if (shift != 0) 
+	{
+		const uint64_t rotHi = (hi >> shift) | (lo << (64 - shift));
+		lo = (lo >> shift) | (hi << (64 - shift));
+		hi = rotHi;
+	}
+
+	out[0] = hi;
+	out[1] = lo;
 }
 
 
@@ -286,23 +675,39 @@ void op_DXYN(CpuManager& cpuMan)
 	ASSERT_MSG(!cpuMan.GetFlags(Cpu::BAD_RENDER), "BAD RENDER");
 
 	VF = 0;
-	const auto res = cpuMan.GetGfxRes() - 1;
+	const auto res = cpuMan.GetGfxRes();
 	const auto vx = VX;
 	const auto vy = VY;
 	const int height = N;
+	cpuMan.MarkDirtyRows(vy, height);
 	const uint8_t* data =  cpuMan.GetMemory() + cpuMan.GetIndexRegister();
 
-	for (int y = 0; y < height; ++y) {
-		const uint8_t byte = *data++;
-		for (int pix = 0; pix < 8; ++pix) {
-			const bool bit = (byte & (0x80 >> pix)) != 0;
-			const auto xpos = (vx + pix) & res.x;
-			const auto ypos = (vy + y) & res.y;
-			auto& gfxPixel = cpuMan.GetGfx(xpos, ypos);
-			VF |= ((gfxPixel != 0) && bit);
-			gfxPixel ^= bit ? ~0 : 0;
+	// 64 pixels rows are one word, rotate and xor them in place
+	if (res.x == 64)
+	{
+		uint64_t* const plane = cpuMan.GetPlane();
+		const int shift = vx & 63;
+		uint64_t erased = 0;
+
+		for (int y = 0; y < height; ++y) 
+		{
+			const uint64_t bits = static_cast<uint64_t>(data[y]) << 56;
+			const uint64_t rotated = (bits >> shift) | (bits << ((64 - shift) & 63));
+			uint64_t& row = plane[((vy + y) & (res.y - 1)) * 2];
+			erased |= row & rotated;
+			row ^= rotated;
 		}
+
+		VF = erased != 0;
+		return;
 	}
+
+	uint64_t sprite[16 * 2];
+
+	for (int y = 0; y < height; ++y)
+		rotate_row(sprite + (y * 2), res.x, vx, data[y] << 8);
+
+	VF = GetGfxKernels().xorSprite(cpuMan.GetPlane(), res.y, sprite, vy, height);
 }
 
 
@@ -312,7 +717,9 @@ void op_DXYN_ex(CpuManager& cpuMan)
 {
 	ASSERT_MSG(!cpuMan.GetFlags(Cpu::BAD_RENDER), "BAD RENDER");
 
-	if (N) {
+	// DXYN with N != 0, or any DXYN out of extended mode,
+	// draws 8xN sprites
+	if (N || !cpuMan.GetFlags(Cpu::EXTENDED_MODE)) {
 		op_DXYN(cpuMan);
 		return; 
 	}
@@ -320,21 +727,16 @@ void op_DXYN_ex(CpuManager& cpuMan)
 	VF = 0;
 	const auto vx = VX;
 	const auto vy = VY;
-	const auto res = cpuMan.GetGfxRes() - 1;
+	const auto res = cpuMan.GetGfxRes();
+	cpuMan.MarkDirtyRows(vy, 16);
 	const uint8_t* data = cpuMan.GetMemory() + cpuMan.GetIndexRegister();
-	for (int y = 0; y < 16; ++y) {
-		for (int x = 0; x < 2; ++x) {
-			const uint8_t byte = *data++;
-			for (int pix = 0; pix < 8; ++pix) {
-				const bool bit = byte & (0x80 >> pix);
-				const auto xpos = (vx + (x * 8) + pix) & res.x;
-				const auto ypos = (vy + y) & res.y;
-				auto& gfxPix = cpuMan.GetGfx(xpos, ypos);
-				VF |= ((gfxPix!=0) && bit);
-				gfxPix ^= bit ? ~0 : 0;
-			}
-		}
-	}
+	uint64_t sprite[16 * 2];
+
+	// 16x16 sprite, 2 bytes per row
+	for (int y = 0; y < 16; ++y, data += 2)
+		rotate_row(sprite + (y * 2), res.x, vx, data[0] << 8 | data[1]);
+
+	VF = GetGfxKernels().xorSprite(cpuMan.GetPlane(), res.y, sprite, vy, 16);
 }
 
 
@@ -347,27 +749,32 @@ void op_EXxx(CpuManager& cpuMan)
 {
 	switch (N)
 	{
-		case 0xE: // EX9E  Skips the next instruction if the key stored in VX is pressed.
-			ASSERT_MSG(!cpuMan.GetFlags(Cpu::BAD_INPUT), "Cpu::Input, null or not initialized!");
-			
-			if (cpuMan.GetInput()->IsKeyPressed((Key)VX))
-				cpuMan.SetPC( cpuMan.GetPC() + 2 );
-			
-			break;
+		case 0xE: op_EX9E(cpuMan); break;
+		case 0x1: op_EXA1(cpuMan); break;
+		default: UnknownOpcode(cpuMan); break;
+	}
+}
 
 
-		case 0x1: // 0xEXA1  Skips the next instruction if the key stored in VX isn't pressed.
-			ASSERT_MSG(!cpuMan.GetFlags(Cpu::BAD_INPUT), "Cpu::Input, null or not initialized!");
-			
-			if (!cpuMan.GetInput()->IsKeyPressed((Key)VX))
-				cpuMan.SetPC( cpuMan.GetPC() + 2 );
-			
-			break;
 
-		default: 
-			UnknownOpcode(cpuMan); 
-			break;
-	}
+// EX9E  Skips the next instruction if the key stored in VX is pressed.
+void op_EX9E(CpuManager& cpuMan)
+{
+	ASSERT_MSG(!cpuMan.GetFlags(Cpu::BAD_INPUT), "Cpu::Input, null or not initialized!");
+
+	if (cpuMan.GetInput()->IsKeyPressed((Key)VX))
+		cpuMan.SetPC( cpuMan.GetPC() + 2 );
+}
+
+
+
+// EXA1  Skips the next instruction if the key stored in VX isn't pressed.
+void op_EXA1(CpuManager& cpuMan)
+{
+	ASSERT_MSG(!cpuMan.GetFlags(Cpu::BAD_INPUT), "Cpu::Input, null or not initialized!");
+
+	if (!cpuMan.GetInput()->IsKeyPressed((Key)VX))
+		cpuMan.SetPC( cpuMan.GetPC() + 2 );
 }
 
 
@@ -390,7 +797,7 @@ void op_EXxx(CpuManager& cpuMan)
 // 8 - D ; unknown opcodes
 // E     ; last instruction for this table
 // F     ; unknown opcode
-static InstrTable op_8XYx_Table[16] =
+static const InstrTable op_8XYx_Table[16] =
 {
 	op_8XY0, op_8XY1, op_8XY2, op_8XY3,
 	op_8XY4, op_8XY5, op_8XY6, op_8XY7,
@@ -401,7 +808,7 @@ static InstrTable op_8XYx_Table[16] =
 
 void op_8XYx(CpuManager& cpuMan)
 {
-	ASSERT_MSG(static_cast<size_t>(N) < arr_size(op_8XYx_Table),
+	ASSERT_MSG(static_cast<size_t>(N) < (sizeof(op_8XYx_Table) / sizeof(InstrTable)),
                    "op_8XYx_Table Overflow!");
 
 	// call it
@@ -460,6 +867,15 @@ void op_8XY3(CpuManager& cpuMan)
 // 8XY4: Adds VY to VX . VF is set to 1 when theres a carry, and to 0 when there isn't
 void op_8XY4(CpuManager& cpuMan)
 {
+#if defined(XCHIP_LAZY_VF)
+	// VF is computed when it is read, unless VF is an operand
+	if (X != 0xF && Y != 0xF) {
+		const uint8_t vy = VY;
+		cpuMan.SetLazyFlag(0x4, VX, vy);
+		VX += vy;
+		return;
+	}
+#endif
 	uint8_t& vx = VX;
 	uint16_t result = vx + VY; // compute sum
 	VF = (result & 0xff00) != 0 ? 1 : 0; // check carry
@@ -473,6 +889,14 @@ void op_8XY4(CpuManager& cpuMan)
 // 8XY5: VY is subtracted from VX. VF is set to 0 when there's a borrow, and 1 when there isn't.
 void op_8XY5(CpuManager& cpuMan)
 {
+#if defined(XCHIP_LAZY_VF)
+	if (X != 0xF && Y != 0xF) {
+		const uint8_t vy = VY;
+		cpuMan.SetLazyFlag(0x5, VX, vy);
+		VX -= vy;
+		return;
+	}
+#endif
 	const uint8_t vy = VY;
 	uint8_t& vx = VX;
 	VF = vy > vx  ? 0 : 1; // check borrow ( VY > VX )
@@ -483,6 +907,13 @@ void op_8XY5(CpuManager& cpuMan)
 // 8XY6: Shifts VX right by one. VF is set to the value of the least significant bit of VX before the shift.
 void op_8XY6(CpuManager& cpuMan)
 {
+#if defined(XCHIP_LAZY_VF)
+	if (X != 0xF) {
+		cpuMan.SetLazyFlag(0x6, VX, 0);
+		VX >>= 1;
+		return;
+	}
+#endif
 	uint8_t& vx = VX;
 	VF = vx & 0x1; // check the least significant bit
 	vx >>= 1;
@@ -492,6 +923,14 @@ void op_8XY6(CpuManager& cpuMan)
 // 8XY7: Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when there isn't.
 void op_8XY7(CpuManager& cpuMan)
 {
+#if defined(XCHIP_LAZY_VF)
+	if (X != 0xF && Y != 0xF) {
+		const uint8_t vy = VY;
+		cpuMan.SetLazyFlag(0x7, VX, vy);
+		VX = vy - VX;
+		return;
+	}
+#endif
 	const uint8_t vy = VY;
 	uint8_t& vx = VX; 
 	VF = vx > vy ? 0 : 1; // check borrow ( VX > VY )
@@ -508,6 +947,13 @@ void op_8XY7(CpuManager& cpuMan)
 // 8XYE Shifts VX left by one. VF is set to the value of the most significant bit of VX before the shift.
 void op_8XYE(CpuManager& cpuMan)
 {
+#if defined(XCHIP_LAZY_VF)
+	if (X != 0xF) {
+		cpuMan.SetLazyFlag(0xE, VX, 0);
+		VX <<= 1;
+		return;
+	}
+#endif
 	uint8_t& vx = VX;
 	VF = ((vx & 0x80) == 0x80) ? 1 : 0;  // check the most significant bit
 	vx = vx << 1;
@@ -526,7 +972,7 @@ void op_8XYE(CpuManager& cpuMan)
 /******** OP_FXxx START *********/
 
 // FXxxx subtable start
-static InstrTable op_FXxx_Table[] =
+static const InstrTable op_FXxx_Table[] =
 {
 	op_FX30, UnknownOpcode, UnknownOpcode,
 	op_FX33, UnknownOpcode, op_FXx5, UnknownOpcode,
@@ -539,7 +985,7 @@ static InstrTable op_FXxx_Table[] =
 
 void op_FXxx(CpuManager& cpuMan) // 9 instructions.
 {
-	ASSERT_MSG(static_cast<size_t>(N) < arr_size(op_FXxx_Table), 
+	ASSERT_MSG(static_cast<size_t>(N) < (sizeof(op_FXxx_Table) / sizeof(InstrTable)), 
                "op_FXxx_Table overflow...");
 
 	op_FXxx_Table[N](cpuMan);
@@ -568,7 +1014,19 @@ void op_FX0A(CpuManager& cpuMan)
 {
 	ASSERT_MSG(!cpuMan.GetFlags(Cpu::BAD_INPUT), "Cpu::input, null or not initialized!");
 
-	VX = static_cast<uint8_t>(cpuMan.GetInput()->WaitKeyPress());
+	const auto pc = cpuMan.GetPC();
+	cpuMan.SetFlags(Cpu::WAIT_KEY);
+	const Key key = cpuMan.GetInput()->WaitKeyPress();
+
+	// a reset while waiting moved pc, the key is not for this program
+	if (cpuMan.GetPC() != pc)
+		return;
+
+	// no key when the wait was given up, FX0A runs again
+	if (key == Key::NO_KEY_PRESSED)
+		cpuMan.SetPC(pc - 2);
+	else
+		VX = static_cast<uint8_t>(key);
 }
 
 
@@ -577,46 +1035,59 @@ void op_FX0A(CpuManager& cpuMan)
 
 void op_FXx5(CpuManager& cpuMan)
 {
-
 	switch (NN)
 	{
-		case 0x15: // FX15  Sets the delay timer to VX.
-			cpuMan.SetDelayTimer( VX );
-			break;
+		case 0x15: op_FX15(cpuMan); break;
+		case 0x55: op_FX55(cpuMan); break;
+		case 0x65: op_FX65(cpuMan); break;
+		case 0x75: op_FX75(cpuMan); break;
+		case 0x85: op_FX85(cpuMan); break;
+		default: UnknownOpcode(cpuMan); break;
+	}
+}
 
 
-		case 0x55: //FX55  Stores V0 to VX in memory starting at address I
-			ASSERT_MSG(static_cast<size_t>(X+1) < (cpuMan.GetMemorySize() - cpuMan.GetIndexRegister()),
-                                     "memory overflow");
 
-			std::copy_n(cpuMan.GetRegisters(), X+1, &cpuMan.GetMemory(cpuMan.GetIndexRegister()));
-			break;
+// FX15  Sets the delay timer to VX.
+void op_FX15(CpuManager& cpuMan)
+{
+	cpuMan.SetDelayTimer( VX );
+}
 
-		case 0x65: //FX65  Fills V0 to VX with values from memory starting at address I.
-			ASSERT_MSG(static_cast<size_t>(X+1) < cpuMan.GetRegistersSize(),
-                                    "registers overflow");
 
-			std::copy_n(&cpuMan.GetMemory(cpuMan.GetIndexRegister()), X+1, cpuMan.GetRegisters());
-			break;
 
-		case 0x75: // 0xFX75* SuperChip: Store V0...VX in RPL user flags ( X <= 7 )
-		{
-			constexpr auto rplOffset = arr_size(fonts::chip8DefaultFont) + arr_size(fonts::chip8HiResFont);
-			std::copy_n(cpuMan.GetRegisters(),  VX, cpuMan.GetMemory() + rplOffset);
-			break;
-		}
-		case 0x85: // 0xFX85* SuperChip: Read V0...VX from RPL user flags ( X <= 7 )
-		{
-			constexpr auto rplOffset = arr_size(fonts::chip8DefaultFont) + arr_size(fonts::chip8HiResFont);
-			std::copy_n(cpuMan.GetMemory() + rplOffset, VX, cpuMan.GetRegisters());
-			break;
-		}
-		default: 
-			UnknownOpcode(cpuMan); 
-			break;
+// FX55  Stores V0 to VX in memory starting at address I
+void op_FX55(CpuManager& cpuMan)
+{
+	std::copy_n(cpuMan.GetRegisters(), X+1, &cpuMan.GetMemory(cpuMan.GetIndexRegister()));
+	cpuMan.InvalidateInstrCache(cpuMan.GetIndexRegister(), X+1);
+}
 
 
-	}
+
+// FX65  Fills V0 to VX with values from memory starting at address I.
+void op_FX65(CpuManager& cpuMan)
+{
+	std::copy_n(&cpuMan.GetMemory(cpuMan.GetIndexRegister()), X+1, cpuMan.GetRegisters());
+}
+
+
+
+// 0xFX75* SuperChip: Store V0...VX in RPL user flags ( X <= 7 )
+void op_FX75(CpuManager& cpuMan)
+{
+	constexpr auto rplOffset = sizeof(fonts::chip8DefaultFont) + sizeof(fonts::chip8HiResFont);
+	std::copy_n(cpuMan.GetRegisters(), X + 1, cpuMan.GetMemory() + rplOffset);
+	cpuMan.InvalidateInstrCache(rplOffset, X + 1);
+}
+
+
+
+// 0xFX85* SuperChip: Read V0...VX from RPL user flags ( X <= 7 )
+void op_FX85(CpuManager& cpuMan)
+{
+	constexpr auto rplOffset = sizeof(fonts::chip8DefaultFont) + sizeof(fonts::chip8HiResFont);
+	std::copy_n(cpuMan.GetMemory() + rplOffset, X + 1, cpuMan.GetRegisters());
 }
 
 
@@ -662,15 +1133,12 @@ void op_FX29(CpuManager& cpuMan)
 //  the tens digit at location I+1, and the ones digit at location I+2.)
 void op_FX33(CpuManager& cpuMan)
 {
-	ASSERT_MSG(cpuMan.GetMemorySize() > (cpuMan.GetIndexRegister() + 2),
-                "Cpu::I + 2 overflows Cpu::memory!");
-
 	auto* memory = cpuMan.GetMemory() + cpuMan.GetIndexRegister();
 	const uint8_t vx = VX;
 	memory[2] = vx % 10;
 	memory[1] = (vx / 10) % 10;
 	memory[0] = (vx / 100);
-
+	cpuMan.InvalidateInstrCache(cpuMan.GetIndexRegister(), 3);
 }
 
 
@@ -690,12 +1158,148 @@ void op_FX33(CpuManager& cpuMan)
 
 
 
+// resolves the final handler of a opcode and extracts its operands.
+// the result does not depend on the cpu state, so it can be cached.
+DecodedInstr DecodeInstruction(const uint16_t opcode)
+{
+	const uint8_t n = opcode & 0x000f;
+	DecodedInstr instr;
+	instr.opcode = opcode;
+	instr.nnn = opcode & 0x0fff;
+	instr.x = (opcode & 0x0f00) >> 8;
+	instr.y = (opcode & 0x00f0) >> 4;
+	instr.nn = opcode & 0x00ff;
+	instr.fusion = 0;
+
+	switch (opcode >> 12)
+	{
+		case 0x0:
+			instr.handler = opcode == 0x00E0 ? op_00E0 
+			              : opcode == 0x00EE ? op_00EE : op_0xxx;
+			break;
+
+		// DXY0 depends on the EXTENDED_MODE flag, op_DXYN_ex checks it
+		case 0xD: instr.handler = n ? op_DXYN : op_DXYN_ex; break;
+		case 0x8: instr.handler = op_8XYx_Table[n]; break;
+
+		case 0xE:
+			instr.handler = n == 0xE ? op_EX9E 
+			              : n == 0x1 ? op_EXA1 : UnknownOpcode;
+			break;
+
+		case 0xF:
+			if (n >= (sizeof(op_FXxx_Table) / sizeof(InstrTable))) 
+				instr.handler = UnknownOpcode;
+			else if (op_FXxx_Table[n] != op_FXx5)
+				instr.handler = op_FXxx_Table[n];
+			else
+				instr.handler = instr.nn == 0x15 ? op_FX15 : instr.nn == 0x55 ? op_FX55 
+				              : instr.nn == 0x65 ? op_FX65 : instr.nn == 0x75 ? op_FX75 
+				              : instr.nn == 0x85 ? op_FX85 : UnknownOpcode;
+			break;
+
+		default: instr.handler = instrTable[opcode >> 12]; break;
+	}
+
+	return instr;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 
 
 
 
 
 
+// true if the instruction must be the last one of a block:
+// it may change pc, write memory, wait or set the EXIT flag.
+static bool is_block_end(const DecodedInstr& instr)
+{
+	switch (instr.opcode >> 12)
+	{
+		case 0x0: return instr.handler != op_00E0;
+		case 0x1: case 0x2: case 0x3: case 0x4:
+		case 0x5: case 0x9: case 0xB: case 0xE: 
+			return true;
+		case 0xF:
+			return instr.handler == op_FX0A || instr.handler == op_FX33
+			    || instr.handler == op_FX55 || instr.handler == op_FX75
+			    || instr.handler == UnknownOpcode;
+		default:
+			return instr.handler == UnknownOpcode;
+	}
+}
+
+
+
+static InstrBlock* translate_block(CpuManager& cpuMan, const size_t pc)
+{
+	constexpr size_t maxBlockSize = 64;
+	DecodedInstr code[maxBlockSize];
+	size_t size = 0;
+
+	for (size_t addr = pc; size < maxBlockSize && (addr + 1) < cpuMan.GetMemorySize(); addr += 2)
+	{
+		auto& instr = cpuMan.GetInstrCache(addr);
+
+		if (!instr.handler)
+			instr = DecodeInstruction(cpuMan.GetMemory(addr) << 8 | cpuMan.GetMemory(addr + 1));
+
+		code[size++] = instr;
+
+		if (is_block_end(instr))
+			break;
+	}
+
+	if (size == 0)
+		return nullptr;
+
+	auto* const block = cpuMan.NewBlock(pc, size);
+	std::copy_n(code, size, block->code);
+	return block;
+}
+
+
+
+
+// runs the block from its instruction 'first', up to 'count' instructions.
+// stopping before the end saves the block to be resumed.
+static size_t run_block(CpuManager& cpuMan, InstrBlock& block, const size_t first, const size_t count)
+{
+	const size_t left = block.size - first;
+	const size_t size = left < count ? left : count;
+	const DecodedInstr* instr = block.code + first;
+	const DecodedInstr* const end = instr + size;
+
+	// only the last instruction of a block reads pc,
+	// so pc is updated once for all of them
+	cpuMan.SetPC(cpuMan.GetPC() + size * 2);
+
+	for (; instr != end; ++instr)
+	{
+		cpuMan.SetInstr(*instr);
+		instr->handler(cpuMan);
+	}
+
+	if (size < left)
+		cpuMan.SetResumeBlock(&block);
+
+	return size;
+}
+
+
 
 
 
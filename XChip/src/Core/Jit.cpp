@@ -0,0 +1,422 @@
+/*
+
+XChip - A chip8 lib and emulator.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <Utix/Log.h>
+#include <Utix/Assert.h>
+
+#include <XChip/Core/Jit.h>
+#include <XChip/Core/Instructions.h>
+
+#if defined(__linux__) && defined(__x86_64__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+namespace xchip {
+
+using namespace utix;
+
+
+
+JitArena::JitArena() noexcept
+{
+
+}
+
+
+
+JitArena::~JitArena()
+{
+	this->Dispose();
+}
+
+
+
+
+
+#if defined(__linux__) && defined(__x86_64__)
+
+// local functions declarations
+static void emit_block(const InstrBlock& block, uint8_t*& out);
+static bool emit_native(const DecodedInstr& instr, uint8_t*& out);
+static void emit_call(const DecodedInstr& instr, uint8_t*& out);
+
+
+// worst case size of a compiled block
+constexpr size_t maxCodeSize = 4096;
+
+
+
+bool JitArena::Initialize(const size_t size) noexcept
+{
+	if (m_code != nullptr)
+		this->Dispose();
+
+	void* const code = mmap(nullptr, size, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (code == MAP_FAILED) {
+		LogError("Could not map JitArena memory");
+		return false;
+	}
+
+	m_code = static_cast<uint8_t*>(code);
+	m_size = size;
+	m_used = 0;
+	m_full = false;
+	return true;
+}
+
+
+
+void JitArena::Dispose() noexcept
+{
+	if (m_code != nullptr) {
+		munmap(m_code, m_size);
+		m_code = nullptr;
+		m_size = 0;
+		m_used = 0;
+		m_full = false;
+	}
+}
+
+
+
+
+// compiles the block and sets its native entry.
+// returns false only when the arena has no space left,
+// blocks which could not be compiled keep being interpreted.
+bool JitArena::Compile(InstrBlock& block)
+{
+	ASSERT_MSG(m_code != nullptr, "JitArena is not initialized");
+
+	uint8_t buffer[maxCodeSize];
+	uint8_t* out = buffer;
+
+	emit_block(block, out);
+	const size_t size = static_cast<size_t>(out - buffer);
+
+	if (size > (m_size - m_used)) {
+		m_full = true;
+		return false;
+	}
+
+	// only the pages being written lose PROT_EXEC
+	const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	uint8_t* const dest = m_code + m_used;
+	uint8_t* const pageBeg = m_code + (m_used & ~(pageSize - 1));
+	const size_t protSize = static_cast<size_t>((dest + size) - pageBeg);
+
+	if (mprotect(pageBeg, protSize, PROT_READ | PROT_WRITE) != 0) {
+		LogError("Could not unprotect JitArena memory");
+		return true;
+	}
+
+	memcpy(dest, buffer, size);
+	mprotect(pageBeg, protSize, PROT_READ | PROT_EXEC);
+
+	// keep the next block 16 bytes aligned
+	m_used += (size + 15) & ~static_cast<size_t>(15);
+	if (m_used > m_size)
+		m_used = m_size;
+
+	block.native = reinterpret_cast<void(*)(CpuManager&, Cpu&)>(dest);
+	return true;
+}
+
+
+
+
+
+
+/*
+ * x86-64 code generation ( System V ABI )
+ *
+ * rbx = Cpu*, r12 = CpuManager*, r13 = Cpu::registers
+ * pc and I are 32 bits, the opcode 16 bits. the upper half
+ * of pc and I is always 0, so 16 bits adds wrap them at 0xFFFF.
+ *
+ * like ExecuteBlocks, pc is set to the end of the block before
+ * the first instruction, so terminators see the same pc.
+ * instructions without a native version call their handler.
+ */
+
+inline void emit8(uint8_t*& out, const uint8_t v) { *out++ = v; }
+inline void emit16(uint8_t*& out, const uint16_t v) { memcpy(out, &v, 2); out += 2; }
+inline void emit32(uint8_t*& out, const uint32_t v) { memcpy(out, &v, 4); out += 4; }
+inline void emit64(uint8_t*& out, const uint64_t v) { memcpy(out, &v, 8); out += 8; }
+
+inline void emit(uint8_t*& out, std::initializer_list<uint8_t> bytes)
+{
+	for (const auto byte : bytes)
+		*out++ = byte;
+}
+
+
+// modrm of [rbx + disp32] and [r13 + disp8]
+inline uint8_t cpu_mem(const uint8_t reg) { return 0x80 | (reg << 3) | 3; }
+inline uint8_t reg_mem(const uint8_t reg) { return 0x40 | (reg << 3) | 5; }
+
+constexpr uint8_t EAX = 0, ECX = 1, EDX = 2;
+constexpr uint32_t cpuPC = offsetof(Cpu, pc);
+constexpr uint32_t cpuI = offsetof(Cpu, I);
+constexpr uint32_t cpuOpcode = offsetof(Cpu, opcode);
+constexpr uint32_t cpuDelayTimer = offsetof(Cpu, delayTimer);
+constexpr uint32_t cpuRegisters = offsetof(Cpu, registers);
+
+
+// movzx reg, byte [r13 + index]
+inline void load_reg(uint8_t*& out, const uint8_t reg, const uint8_t index)
+{
+	emit(out, { 0x41, 0x0F, 0xB6, reg_mem(reg), index });
+}
+
+// mov byte [r13 + index], reg8
+inline void store_reg(uint8_t*& out, const uint8_t reg, const uint8_t index)
+{
+	emit(out, { 0x41, 0x88, reg_mem(reg), index });
+}
+
+// mov dword [rbx + disp], imm32
+inline void store_cpu_imm(uint8_t*& out, const uint32_t disp, const uint32_t imm)
+{
+	emit(out, { 0xC7, cpu_mem(0) });
+	emit32(out, disp);
+	emit32(out, imm);
+}
+
+// the opcode and its operands, as CpuManager::SetInstr copies them:
+// mov rax, imm64; mov qword [rbx + opcode], rax
+inline void store_opcode(uint8_t*& out, const DecodedInstr& instr)
+{
+	uint64_t operands;
+	memcpy(&operands, &instr.opcode, 8);
+	emit(out, { 0x48, 0xB8 });
+	emit64(out, operands);
+	emit(out, { 0x48, 0x89, cpu_mem(EAX) });
+	emit32(out, cpuOpcode);
+}
+
+// skips the next instruction: jcc over 'add word [rbx + pc], 2'
+inline void emit_skip(uint8_t*& out, const uint8_t jcc)
+{
+	emit(out, { jcc, 8, 0x66, 0x83, cpu_mem(0) });
+	emit32(out, cpuPC);
+	emit8(out, 2);
+}
+
+
+
+
+
+static void emit_block(const InstrBlock& block, uint8_t*& out)
+{
+	// push rbx; push r12; push r13 ( keeps rsp 16 bytes aligned )
+	emit(out, { 0x53, 0x41, 0x54, 0x41, 0x55 });
+	// mov r12, rdi; mov rbx, rsi
+	emit(out, { 0x49, 0x89, 0xFC, 0x48, 0x89, 0xF3 });
+	// lea r13, [rbx + registers]
+	emit(out, { 0x4C, 0x8D, cpu_mem(5) });
+	emit32(out, cpuRegisters);
+
+	store_cpu_imm(out, cpuPC, (block.begin + block.size * 2) & Cpu::ADDRESS_MASK);
+
+	const DecodedInstr* const end = block.code + block.size;
+	for (const DecodedInstr* instr = block.code; instr != end; ++instr)
+	{
+		if (!emit_native(*instr, out))
+			emit_call(*instr, out);
+	}
+
+	store_opcode(out, end[-1]);
+	// pop r13; pop r12; pop rbx; ret
+	emit(out, { 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3 });
+}
+
+
+
+
+static void emit_call(const DecodedInstr& instr, uint8_t*& out)
+{
+	store_opcode(out, instr);
+	// mov rdi, r12; mov rax, handler; call rax
+	emit(out, { 0x4C, 0x89, 0xE7, 0x48, 0xB8 });
+	emit64(out, reinterpret_cast<uint64_t>(instr.handler));
+	emit(out, { 0xFF, 0xD0 });
+}
+
+
+
+
+// emits the instructions which only touch V registers, I, pc and
+// the delay timer. VX is reloaded after VF is written, as the
+// handlers do, so X == 0xF gives the same result.
+static bool emit_native(const DecodedInstr& instr, uint8_t*& out)
+{
+	using namespace instructions;
+	const uint8_t x = instr.x;
+	const uint8_t y = instr.y;
+	const auto handler = instr.handler;
+
+	if (handler == op_6XNN) {
+		// mov byte [r13 + x], nn
+		emit(out, { 0x41, 0xC6, reg_mem(0), x, instr.nn });
+	}
+	else if (handler == op_7XNN) {
+		// add byte [r13 + x], nn
+		emit(out, { 0x41, 0x80, reg_mem(0), x, instr.nn });
+	}
+	else if (handler == op_8XY0) {
+		load_reg(out, EAX, y);
+		store_reg(out, EAX, x);
+	}
+	else if (handler == op_8XY1 || handler == op_8XY2 || handler == op_8XY3) {
+		// or / and / xor byte [r13 + x], al
+		const uint8_t op = handler == op_8XY1 ? 0x08 : handler == op_8XY2 ? 0x20 : 0x30;
+		load_reg(out, EAX, y);
+		emit(out, { 0x41, op, reg_mem(EAX), x });
+	}
+	else if (handler == op_8XY4) {
+		load_reg(out, EAX, x);
+		load_reg(out, ECX, y);
+		// add eax, ecx; mov edx, eax; shr edx, 8
+		emit(out, { 0x01, 0xC8, 0x89, 0xC2, 0xC1, 0xEA, 0x08 });
+		store_reg(out, EDX, 0xF);
+		store_reg(out, EAX, x);
+	}
+	else if (handler == op_8XY5) {
+		load_reg(out, EAX, x);
+		load_reg(out, ECX, y);
+		// cmp eax, ecx; setae dl
+		emit(out, { 0x39, 0xC8, 0x0F, 0x93, 0xC2 });
+		store_reg(out, EDX, 0xF);
+		load_reg(out, EAX, x);
+		// sub eax, ecx
+		emit(out, { 0x29, 0xC8 });
+		store_reg(out, EAX, x);
+	}
+	else if (handler == op_8XY6) {
+		load_reg(out, EAX, x);
+		// and eax, 1
+		emit(out, { 0x83, 0xE0, 0x01 });
+		store_reg(out, EAX, 0xF);
+		load_reg(out, EAX, x);
+		// shr eax, 1
+		emit(out, { 0xD1, 0xE8 });
+		store_reg(out, EAX, x);
+	}
+	else if (handler == op_8XY7) {
+		load_reg(out, ECX, y);
+		load_reg(out, EAX, x);
+		// cmp ecx, eax; setae dl
+		emit(out, { 0x39, 0xC1, 0x0F, 0x93, 0xC2 });
+		store_reg(out, EDX, 0xF);
+		load_reg(out, EAX, x);
+		// mov edx, ecx; sub edx, eax
+		emit(out, { 0x89, 0xCA, 0x29, 0xC2 });
+		store_reg(out, EDX, x);
+	}
+	else if (handler == op_8XYE) {
+		load_reg(out, EAX, x);
+		// shr eax, 7
+		emit(out, { 0xC1, 0xE8, 0x07 });
+		store_reg(out, EAX, 0xF);
+		load_reg(out, EAX, x);
+		// add eax, eax
+		emit(out, { 0x01, 0xC0 });
+		store_reg(out, EAX, x);
+	}
+	else if (handler == op_ANNN) {
+		store_cpu_imm(out, cpuI, instr.nnn);
+	}
+	else if (handler == op_FX1E) {
+		load_reg(out, EAX, x);
+		// add word [rbx + I], ax
+		emit(out, { 0x66, 0x01, cpu_mem(EAX) });
+		emit32(out, cpuI);
+	}
+	else if (handler == op_FX29) {
+		load_reg(out, EAX, x);
+		// lea eax, [rax + rax * 4]; add eax, font index
+		emit(out, { 0x8D, 0x04, 0x80, 0x05 });
+		emit32(out, static_cast<uint32_t>(CpuManager::GetDefaultFontIndex()));
+		// mov dword [rbx + I], eax
+		emit(out, { 0x89, cpu_mem(EAX) });
+		emit32(out, cpuI);
+	}
+	else if (handler == op_FX07) {
+		// movzx eax, byte [rbx + delayTimer]
+		emit(out, { 0x0F, 0xB6, cpu_mem(EAX) });
+		emit32(out, cpuDelayTimer);
+		store_reg(out, EAX, x);
+	}
+	else if (handler == op_FX15) {
+		load_reg(out, EAX, x);
+		// mov byte [rbx + delayTimer], al
+		emit(out, { 0x88, cpu_mem(EAX) });
+		emit32(out, cpuDelayTimer);
+	}
+	else if (handler == op_1NNN) {
+		store_cpu_imm(out, cpuPC, instr.nnn);
+	}
+	else if (handler == op_3XNN || handler == op_4XNN) {
+		// cmp byte [r13 + x], nn; jne / je
+		emit(out, { 0x41, 0x80, reg_mem(7), x, instr.nn });
+		emit_skip(out, handler == op_3XNN ? 0x75 : 0x74);
+	}
+	else if (handler == op_5XY0 || handler == op_9XY0) {
+		load_reg(out, EAX, x);
+		// cmp al, byte [r13 + y]; jne / je
+		emit(out, { 0x41, 0x3A, reg_mem(EAX), y });
+		emit_skip(out, handler == op_5XY0 ? 0x75 : 0x74);
+	}
+	else {
+		return false;
+	}
+
+	return true;
+}
+
+
+
+#else
+
+
+bool JitArena::Initialize(const size_t) noexcept
+{
+	LogError("JitArena is not supported on this platform");
+	return false;
+}
+
+void JitArena::Dispose() noexcept {}
+bool JitArena::Compile(InstrBlock&) { return true; }
+
+
+#endif
+
+
+
+
+
+
+}
@@ -0,0 +1,179 @@
+/*
+
+XChip - A chip8 lib and emulator.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+#include <XChip/Core/Instructions.h>
+
+// one handler per 16 bit opcode, built at compile time.
+// only compiled with the OPCODE_TABLE cmake option: it instantiates
+// tens of thousands of small functions and slows the build down.
+#if defined(XCHIP_OPCODE_TABLE)
+
+namespace xchip { namespace instructions {
+
+
+
+// compile time index sequence, built in log2(N) steps
+template<size_t... I> struct IndexSeq {};
+
+template<class A, class B> struct ConcatSeq;
+template<size_t... A, size_t... B>
+struct ConcatSeq<IndexSeq<A...>, IndexSeq<B...>> { using type = IndexSeq<A..., (sizeof...(A) + B)...>; };
+
+template<size_t N>
+struct MakeSeq : ConcatSeq<typename MakeSeq<N / 2>::type, typename MakeSeq<N - N / 2>::type> {};
+template<> struct MakeSeq<0> { using type = IndexSeq<>; };
+template<> struct MakeSeq<1> { using type = IndexSeq<0>; };
+
+
+
+
+// true for opcodes that get a specialized handler
+constexpr bool is_specialized(const uint16_t op)
+{
+	return ((op >> 12) >= 0x1 && (op >> 12) <= 0xB && (op >> 12) != 0x8)
+	    || ((op >> 12) == 0x8 && ((op & 0xf) <= 0x7 || (op & 0xf) == 0xE))
+	    || ((op >> 12) == 0xF && ((op & 0xf) == 0x0 || (op & 0xf) == 0x7 || (op & 0xf) == 0x9
+	                          || (op & 0xf) == 0xE || (op & 0xff) == 0x15));
+}
+
+
+
+// the final handler of the other opcodes, as DecodeInstruction resolves it
+constexpr InstrTable resolve_handler(const uint16_t op)
+{
+	return (op >> 12) == 0x0 ? (op == 0x00E0 ? op_00E0 : op == 0x00EE ? op_00EE : op_0xxx)
+	     : (op >> 12) == 0xC ? op_CXNN
+	     : (op >> 12) == 0xD ? ((op & 0xf) ? op_DXYN : op_DXYN_ex)
+	     : (op >> 12) == 0xE ? ((op & 0xf) == 0xE ? op_EX9E : (op & 0xf) == 0x1 ? op_EXA1 : UnknownOpcode)
+	     : (op >> 12) == 0xF ? ((op & 0xf) == 0x3 ? op_FX33 : (op & 0xf) == 0x8 ? op_FX18
+	                         : (op & 0xf) == 0xA ? op_FX0A : (op & 0xff) == 0x55 ? op_FX55
+	                         : (op & 0xff) == 0x65 ? op_FX65 : (op & 0xff) == 0x75 ? op_FX75
+	                         : (op & 0xff) == 0x85 ? op_FX85 : UnknownOpcode)
+	     : UnknownOpcode;
+}
+
+
+
+
+// X, Y, N, NN and NNN are constants, the switches fold away
+template<uint16_t OP>
+void op_spec(CpuManager& cpuMan)
+{
+	constexpr size_t x = (OP & 0x0f00) >> 8;
+	constexpr size_t y = (OP & 0x00f0) >> 4;
+	constexpr uint8_t nn = OP & 0x00ff;
+	constexpr uint16_t nnn = OP & 0x0fff;
+
+	switch (OP >> 12)
+	{
+		case 0x1: cpuMan.SetPC(nnn); break;
+		case 0x2:
+			cpuMan.GetStack(cpuMan.GetSP() & 0xF) = cpuMan.GetPC();
+			cpuMan.SetSP(cpuMan.GetSP() + 1);
+			cpuMan.SetPC(nnn);
+			break;
+
+		case 0x3: if (cpuMan.GetRegisters(x) == nn) cpuMan.SetPC(cpuMan.GetPC() + 2); break;
+		case 0x4: if (cpuMan.GetRegisters(x) != nn) cpuMan.SetPC(cpuMan.GetPC() + 2); break;
+		case 0x5: if (cpuMan.GetRegisters(x) == cpuMan.GetRegisters(y)) cpuMan.SetPC(cpuMan.GetPC() + 2); break;
+		case 0x6: cpuMan.GetRegisters(x) = nn; break;
+		case 0x7: cpuMan.GetRegisters(x) += nn; break;
+		case 0x9: if (cpuMan.GetRegisters(x) != cpuMan.GetRegisters(y)) cpuMan.SetPC(cpuMan.GetPC() + 2); break;
+		case 0xA: cpuMan.SetIndexRegister(nnn); break;
+		case 0xB: cpuMan.SetPC(nnn + cpuMan.GetRegisters(0)); break;
+
+		case 0x8:
+		{
+			// VX is read again after VF is set, like the op_8XYx handlers
+			auto& vx = cpuMan.GetRegisters(x);
+			auto& vf = cpuMan.GetRegisters(0xF);
+			const uint8_t vy = cpuMan.GetRegisters(y);
+
+			switch (OP & 0xf)
+			{
+				case 0x0: vx = vy; break;
+				case 0x1: vx |= vy; break;
+				case 0x2: vx &= vy; break;
+				case 0x3: vx ^= vy; break;
+				case 0x4:
+				{
+					const uint16_t result = vx + vy;
+					vf = (result & 0xff00) != 0 ? 1 : 0;
+					vx = (result & 0xff);
+					break;
+				}
+				case 0x5: vf = vy > vx ? 0 : 1; vx -= vy; break;
+				case 0x6: vf = vx & 0x1; vx >>= 1; break;
+				case 0x7: vf = vx > vy ? 0 : 1; vx = vy - vx; break;
+				case 0xE: vf = ((vx & 0x80) == 0x80) ? 1 : 0; vx = vx << 1; break;
+			}
+			break;
+		}
+
+		case 0xF:
+		{
+			auto& vx = cpuMan.GetRegisters(x);
+
+			switch (OP & 0xf)
+			{
+				case 0x0: cpuMan.SetIndexRegister(cpuMan.GetHiResFontIndex() + (vx * 10)); break;
+				case 0x5: cpuMan.SetDelayTimer(vx); break;
+				case 0x7: vx = cpuMan.GetDelayTimer(); break;
+				case 0x9: cpuMan.SetIndexRegister(cpuMan.GetDefaultFontIndex() + (vx * 5)); break;
+				case 0xE: cpuMan.SetIndexRegister(cpuMan.GetIndexRegister() + vx); break;
+			}
+			break;
+		}
+	}
+}
+
+
+
+
+template<uint16_t OP, bool = is_specialized(OP)>
+struct SelectHandler { static constexpr InstrTable value = op_spec<OP>; };
+
+template<uint16_t OP>
+struct SelectHandler<OP, false> { static constexpr InstrTable value = resolve_handler(OP); };
+
+
+template<class S> struct OpcodeTableGen;
+
+template<size_t... I>
+struct OpcodeTableGen<IndexSeq<I...>>
+{
+	static constexpr InstrTable table[sizeof...(I)] = { SelectHandler<static_cast<uint16_t>(I)>::value... };
+};
+
+template<size_t... I>
+constexpr InstrTable OpcodeTableGen<IndexSeq<I...>>::table[sizeof...(I)];
+
+
+
+
+const InstrTable* const opcodeTable = OpcodeTableGen<MakeSeq<0x10000>::type>::table;
+
+
+
+
+}}
+
+
+#endif
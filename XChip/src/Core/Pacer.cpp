@@ -0,0 +1,148 @@
+/*
+
+XChip - A chip8 lib and emulator.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+#include <algorithm>
+#include <thread>
+#include <XChip/Core/Pacer.h>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <time.h>
+#endif
+
+
+
+namespace xchip {
+
+using utix::Duration;
+using std::chrono::duration_cast;
+
+
+// local functions declarations
+static void sleep_until(const Pacer::Clock::time_point time);
+
+// bounds of the spin before a deadline
+constexpr Duration minSpin = std::chrono::microseconds(20);
+constexpr Duration maxSpin = std::chrono::milliseconds(2);
+constexpr size_t Pacer::windowSize;
+
+
+
+
+void Pacer::Start()
+{
+	m_last = Clock::now();
+	m_deadline = m_last + m_period;
+	m_periods = 0;
+	m_missed = 0;
+}
+
+
+
+
+void Pacer::SleepUntil(const Clock::time_point time)
+{
+	const auto wake = time - m_spin;
+
+	if (Clock::now() < wake)
+	{
+		sleep_until(wake);
+
+		// the spin follows twice the average oversleep
+		const auto over = duration_cast<Duration>(Clock::now() - wake);
+		m_spin += (over * 2 - m_spin) / 8;
+		m_spin = std::min(std::max(m_spin, minSpin), maxSpin);
+	}
+
+	while (Clock::now() < time)
+		std::this_thread::yield();
+}
+
+
+
+
+PacingStats Pacer::GetStats() const
+{
+	PacingStats stats;
+	stats.periods = m_periods;
+	stats.missed = m_missed;
+	stats.spin = m_spin;
+	stats.p50 = stats.p99 = stats.max = Duration(0);
+
+	const size_t count = std::min(m_periods, windowSize);
+
+	if (count == 0)
+		return stats;
+
+	int64_t errors[windowSize];
+	std::copy(m_errors, m_errors + count, errors);
+	std::sort(errors, errors + count);
+	stats.p50 = Duration(errors[(count - 1) / 2]);
+	stats.p99 = Duration(errors[(count - 1) * 99 / 100]);
+	stats.max = Duration(errors[count - 1]);
+	return stats;
+}
+
+
+
+
+void Pacer::Record(const Clock::time_point now)
+{
+	const auto interval = duration_cast<Duration>(now - m_last).count();
+	const auto error = interval - m_period.count();
+	m_errors[m_periods % windowSize] = error < 0 ? -error : error;
+
+	++m_periods;
+	m_last = now;
+	m_deadline += m_period;
+
+	// too late to catch up, the schedule restarts from now
+	if (now >= m_deadline)
+	{
+		m_deadline = now + m_period;
+		++m_missed;
+	}
+}
+
+
+
+
+
+static void sleep_until(const Pacer::Clock::time_point time)
+{
+#if defined(__linux__)
+	// steady_clock is CLOCK_MONOTONIC, the absolute sleep doesn't
+	// add the time taken between reading the clock and sleeping
+	const auto ns = duration_cast<Duration>(time.time_since_epoch()).count();
+	timespec ts;
+	ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+	ts.tv_nsec = static_cast<long>(ns % 1000000000);
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+		continue;
+#else
+	std::this_thread::sleep_until(time);
+#endif
+}
+
+
+
+
+}
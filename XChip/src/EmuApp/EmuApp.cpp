@@ -31,6 +31,9 @@ along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
 #include <stdexcept>
 #include <algorithm>
 #include <utility>
+#include <chrono>
+#include <atomic>
+#include <thread>
 
 #include <SDL2/SDL_messagebox.h>
 #include <Utix/Log.h>
@@ -53,11 +56,14 @@ along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
  *	-COL  Color in RGB ex: -COL 100x200x255
  *	-BKG  Background color in RGB ex: -BKG 255x0x0
  *	-FPS  Frame Rate ex: -FPS 30
+ *	-HDL  headless, no window, sound or input: runs N frames unthrottled ex: -HDL 3600
+ *	-SCH  scheduler: INSTR ( default ) one instruction per loop, BURST one 60 hz frame per loop,
+ *	      THREAD INSTR on its own thread, the window presented from the main thread ex: -SCH BURST
  *******************************************************************************************/
 
 /*********************************************************
  * SIGNALS:
- * SIGINT - set g_emulator exitflag
+ * SIGINT - set g_emulator exitflag, with -SCH THREAD an ESCAPE key for the emulation
  * CTRL_EVENT: windows ConsoleCtrlEvents...
  *********************************************************/
 
@@ -66,10 +72,19 @@ along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
 
 static xchip::Emulator g_emulator;
 
+// with -SCH THREAD the signals don't touch g_emulator from the main
+// thread, they raise g_interrupted and the main loop sends an ESCAPE
+static std::atomic<bool> g_threaded { false };
+static std::atomic<bool> g_interrupted { false };
+
 namespace {
 void DisplayErrorMsg(const std::string& title, const std::string& errmsg);
 void LoadPlugins(const utix::CliOpts& opts);
 void ConfigureEmulator(const utix::CliOpts& opts);
+int RunHeadless(const std::string& arg);
+void RunFrameBursts();
+int RunThreaded();
+void PrintPacingStats(const xchip::PacingStats& stats);
 }
 
 #if defined(__linux__) || defined(__APPLE__)
@@ -119,12 +134,21 @@ int main(int argc, char **argv)
 
 
 
+	std::string headless;
+	std::string scheduler;
+
 	try {
-		// initialize with no plugins.
-		if(!g_emulator.Initialize())
+		const CliOpts opts(argc-1, argv+1);
+		headless = opts.GetOpt("-HDL");
+		scheduler = opts.GetOpt("-SCH");
+
+		if (!scheduler.empty() && scheduler != "INSTR" && scheduler != "BURST" && scheduler != "THREAD")
+			throw std::runtime_error("Unknown -SCH scheduler, use INSTR, BURST or THREAD");
+
+		// initialize with no plugins, or with the built in headless ones.
+		if(!(headless.empty() ? g_emulator.Initialize() : g_emulator.InitializeHeadless()))
 			throw std::runtime_error(utix::GetLastLogError());
 
-		const CliOpts opts(argc-1, argv+1);
 		auto romPath = opts.GetOpt("-ROM");
 
 		if (romPath.empty())
@@ -134,7 +158,9 @@ int main(int argc, char **argv)
 			throw std::runtime_error(utix::GetLastLogError());
 	
 
-		LoadPlugins(opts);
+		if(headless.empty())
+			LoadPlugins(opts);
+
 		ConfigureEmulator(opts);
 
 		if(!g_emulator.Good())
@@ -147,6 +173,16 @@ int main(int argc, char **argv)
 	}
 	
 
+	if (!headless.empty())
+		return RunHeadless(headless);
+
+	if (scheduler == "BURST") {
+		RunFrameBursts();
+		return EXIT_SUCCESS;
+	}
+	else if (scheduler == "THREAD") {
+		return RunThreaded();
+	}
 
 	while (!g_emulator.GetExitFlag())
 	{
@@ -158,7 +194,7 @@ int main(int argc, char **argv)
 			g_emulator.Draw();
 	}
 
-
+	PrintPacingStats(g_emulator.GetPacingStats());
 
 	return EXIT_SUCCESS;
 }
@@ -441,6 +477,207 @@ void fps_config(const std::string& arg)
 }
 
 
+// runs 'arg' frames as fast as possible, then prints the speed
+int RunHeadless(const std::string& arg)
+{
+	unsigned long frames = 0;
+
+	try {
+		frames = std::stoul(arg);
+	}
+	catch(std::exception&) {
+		DisplayErrorMsg("RunHeadless", "Bad frames count, example: -HDL 3600");
+		return EXIT_FAILURE;
+	}
+
+	using Clock = std::chrono::steady_clock;
+	const auto begin = Clock::now();
+	unsigned long ran = 0;
+	uint64_t instrs = 0;
+
+	for (; ran < frames && !g_emulator.GetExitFlag(); ++ran)
+		instrs += g_emulator.RunFrame().instrs;
+
+	const std::chrono::duration<double> secs = Clock::now() - begin;
+
+	std::cout << "headless: " << ran << " frames, " << instrs << " instructions in " 
+	          << secs.count() << "s, " << (secs.count() > 0 ? instrs / secs.count() / 1e6 : 0) << " MIPS, "
+	          << (secs.count() > 0 ? ran / secs.count() : 0) << " frames/s\n";
+
+	return EXIT_SUCCESS;
+}
+
+
+
+
+// once per 60 hz frame: pumps the events, runs the frame instructions 
+// in one burst, presents and sleeps until the next frame deadline.
+// prints the time per frame spent running and in the host, and the 
+// frame pacing at the end.
+void RunFrameBursts()
+{
+	using Clock = std::chrono::steady_clock;
+	using utix::Duration;
+	xchip::Pacer pacer;
+	pacer.SetTargetHz(60);
+	pacer.Start();
+
+	unsigned long frames = 0;
+	Duration runTime(0);
+	Duration hostTime(0);
+
+	while (!g_emulator.GetExitFlag())
+	{
+		const auto begin = Clock::now();
+		if (g_emulator.GetRender()->UpdateEvents())
+			g_emulator.Refresh();
+
+		g_emulator.GetInput()->UpdateKeys();
+
+		const auto runBegin = Clock::now();
+		g_emulator.RunFrame();
+		const auto runEnd = Clock::now();
+
+		// at most at the -FPS rate, only when the screen changed
+		if (g_emulator.GetDrawFlag())
+			g_emulator.Draw();
+
+		const auto end = Clock::now();
+		runTime += runEnd - runBegin;
+		hostTime += (runBegin - begin) + (end - runEnd);
+		++frames;
+
+		// after a stall ( FX0A waits ) the lost frames are not run at once
+		pacer.Wait();
+	}
+
+	if (frames > 0)
+	{
+		using std::chrono::duration_cast;
+		using std::chrono::microseconds;
+		std::cout << "frame bursts: " << frames << " frames, per frame " 
+		          << duration_cast<microseconds>(runTime).count() / frames << "us running, "
+		          << duration_cast<microseconds>(hostTime).count() / frames << "us host overhead\n";
+		PrintPacingStats(pacer.GetStats());
+	}
+}
+
+
+
+// the emulation runs on its own thread with the headless render and input,
+// so a slow present doesn't stall it. this thread keeps the window: it 
+// pumps the events, gives the emulation a snapshot of the keys and 
+// presents the frames the emulation publishes.
+int RunThreaded()
+{
+	using xchip::Key;
+	constexpr uint32_t resetKey = 1u << static_cast<uint32_t>(Key::RESET);
+	constexpr uint32_t escapeKey = 1u << static_cast<uint32_t>(Key::ESCAPE);
+
+	static xchip::TripleBuffer frames;
+	std::atomic<uint32_t> keys { 0 };
+	std::atomic<bool> done { false };
+	uint32_t systemKeys = 0;
+
+	auto window = g_emulator.SwapRender();
+	auto keyboard = g_emulator.SwapInput();
+
+	if (!g_emulator.SetHeadlessRender() || !g_emulator.SetHeadlessInput())
+	{
+		DisplayErrorMsg("Fatal Error", utix::GetLastLogError());
+		return EXIT_FAILURE;
+	}
+
+	g_emulator.GetHeadlessInput().SetKeySource(&keys, [](const void* keys) {
+		return static_cast<const std::atomic<uint32_t>*>(keys)->load(std::memory_order_relaxed);
+	});
+
+	g_emulator.SetFrameBuffer(&frames);
+	g_threaded.store(true);
+
+	// closing the window and the system keys reach the emulation as keys
+	window->SetWinCloseCallback(&systemKeys, [](const void* keys) { *(uint32_t*)keys |= escapeKey; });
+	keyboard->SetEscapeKeyCallback(&systemKeys, [](const void* keys) { *(uint32_t*)keys |= escapeKey; });
+	keyboard->SetResetKeyCallback(&systemKeys, [](const void* keys) { *(uint32_t*)keys |= resetKey; });
+
+	std::thread emulation([&done] {
+		while (!g_emulator.GetExitFlag())
+		{
+			g_emulator.UpdateSystems();
+			g_emulator.HaltForNextFlag();
+			if (g_emulator.GetInstrFlag())
+				g_emulator.ExecuteInstr();
+			if (g_emulator.GetDrawFlag())
+				g_emulator.Draw();
+		}
+
+		done.store(true);
+	});
+
+	bool shown = false;
+
+	while (!done.load())
+	{
+		// ESCAPE is kept once pressed, RESET only while it is held
+		systemKeys &= escapeKey;
+
+		if (g_interrupted.load())
+			systemKeys |= escapeKey;
+
+		const bool redraw = window->UpdateEvents() && shown;
+		keyboard->UpdateKeys();
+
+		uint32_t pressed = systemKeys;
+		for (uint32_t key = 0; key < 16; ++key)
+		{
+			if (keyboard->IsKeyPressed(static_cast<Key>(key)))
+				pressed |= 1u << key;
+		}
+
+		keys.store(pressed, std::memory_order_relaxed);
+
+		// the emulation publishes changed frames only, the last
+		// one is drawn again when the window needs it
+		if (frames.Acquire() || redraw)
+		{
+			const auto& frame = frames.GetFront();
+			const auto res = window->GetResolution();
+
+			if ((frame.res.x != res.x || frame.res.y != res.y) && !window->SetResolution(frame.res))
+				systemKeys |= escapeKey;
+
+			window->SetBuffer(frame.pixels);
+			window->DrawBuffer();
+			shown = true;
+		}
+		else
+		{
+			utix::Sleep(std::chrono::milliseconds(1));
+		}
+	}
+
+	emulation.join();
+	g_emulator.SetFrameBuffer(nullptr);
+	PrintPacingStats(g_emulator.GetPacingStats());
+	return EXIT_SUCCESS;
+}
+
+
+
+
+void PrintPacingStats(const xchip::PacingStats& stats)
+{
+	using std::chrono::duration_cast;
+	using std::chrono::microseconds;
+	std::cout << "frame pacing: " << stats.periods << " frames, " << stats.missed << " missed, interval error p50 " 
+	          << duration_cast<microseconds>(stats.p50).count() << "us p99 "
+	          << duration_cast<microseconds>(stats.p99).count() << "us max "
+	          << duration_cast<microseconds>(stats.max).count() << "us\n";
+}
+
+
+
+
 utix::Color get_arg_rgb(const std::string& arg)
 {
 	const auto firstSeparator = arg.find('x');
@@ -498,14 +735,22 @@ void DisplayErrorMsg(const std::string& title, const std::string& errmsg)
 void signals_sigint(const int signum)
 {
 	std::cout << "Received sigint! signum: " << signum << "\nClosing Application!\n";
-	g_emulator.SetExitFlag(true);
+
+	if (g_threaded.load())
+		g_interrupted.store(true);
+	else
+		g_emulator.SetExitFlag(true);
 }
 
 #elif defined(_WIN32)
 bool _stdcall ctrl_handler(DWORD ctrlType)
 {
 	std::cout << "Received ctrlType: " << ctrlType << "\nClosing Application!\n";
-	g_emulator.SetExitFlag(true);
+
+	if (g_threaded.load())
+		g_interrupted.store(true);
+	else
+		g_emulator.SetExitFlag(true);
 	return true;
 }
 #endif
@@ -240,6 +240,12 @@ extern "C" {
 
 
 
+XCHIP_EXPORT int XCHIP_PluginVersion()
+{
+	return XCHIP_PLUGIN_INTERFACE_VERSION;
+}
+
+
 XCHIP_EXPORT iPlugin* XCHIP_LoadPlugin()
 {
 	return new(std::nothrow) SdlInput();
@@ -78,6 +78,7 @@ bool SdlRender::Initialize(const Vec2i& winSize, const Vec2i& res) noexcept
 	});
 
 	m_pitch = res.x * sizeof(uint32_t);
+	m_res = res;
 
 	m_window = SDL_CreateWindow("Chip8 - SdlRender", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 
                                  winSize.x, winSize.y, 
@@ -110,6 +111,8 @@ void SdlRender::Dispose() noexcept
 	SDL_DestroyWindow(m_window);
 	SDL_QuitSubSystem( SDL_INIT_VIDEO );
 	m_window = nullptr;
+	m_texture = nullptr;
+	m_textureRes = 0;
 	m_buffer = nullptr;
 	m_closeClbk = nullptr;
 	m_resizeClbk = nullptr;
@@ -184,13 +187,7 @@ Color SdlRender::GetBackgroundColor() const noexcept
 Vec2i SdlRender::GetResolution() const noexcept
 {
 	_SDLRENDER_INITIALIZED_ASSERT_();
-
-	int x, y;
-	if( SDL_QueryTexture(m_texture, nullptr, nullptr, &x, &y) == 0)
-		return {x, y};
-	
-	LogError("Failed to get SDL_Texture resolution: %s", SDL_GetError());
-	return {0, 0};
+	return m_res;
 }
 
 
@@ -225,6 +222,10 @@ bool SdlRender::UpdateEvents() noexcept
 
 	while (SDL_PollEvent(&m_sdlevent))
 	{
+		// exposed, resized, restored... the window needs a full draw
+		if (m_sdlevent.type == SDL_WINDOWEVENT)
+			m_redraw = true;
+
 		switch (m_sdlevent.type)
 		{
 			case SDL_WINDOWEVENT_RESIZED: // fall
@@ -241,7 +242,8 @@ bool SdlRender::UpdateEvents() noexcept
 		}
 	}
 
-	return false;
+	// true asks the emulator for a draw even if the screen didn't change
+	return m_redraw;
 }
 
 
@@ -252,6 +254,7 @@ bool SdlRender::UpdateEvents() noexcept
 void SdlRender::SetBuffer(const uint32_t* gfx) noexcept 
 { 
 	m_buffer = gfx;
+	m_redraw = true;
 }
 
 
@@ -271,6 +274,14 @@ bool SdlRender::SetResolution(const Vec2i& res) noexcept
 {
 	_SDLRENDER_INITIALIZED_ASSERT_();
 
+	m_redraw = true;
+
+	// a smaller resolution is a view of the current texture
+	if (res.x <= m_textureRes.x && res.y <= m_textureRes.y) {
+		m_res = res;
+		return true;
+	}
+
 	m_pitch = res.x * sizeof(uint32_t);
 	
 	const auto currentColor = this->GetDrawColor();
@@ -279,7 +290,7 @@ bool SdlRender::SetResolution(const Vec2i& res) noexcept
 		return false;
 
 	this->SetDrawColor(currentColor);
-
+	m_res = res;
 	return true;
 }
 
@@ -315,6 +326,7 @@ bool SdlRender::SetDrawColor(const Color& color) noexcept
 		return false;
 	}
 
+	m_redraw = true;
 	return true;
 }
 
@@ -333,6 +345,7 @@ bool SdlRender::SetBackgroundColor(const Color& color) noexcept
 		return false;
 	}
 
+	m_redraw = true;
 	return true;
 }
 
@@ -414,21 +427,75 @@ void SdlRender::DrawBuffer() noexcept
 	_SDLRENDER_INITIALIZED_ASSERT_();
 	ASSERT_MSG(m_buffer != nullptr, "attempt to draw null buffer");
 	
-	SDL_RenderClear(m_rend);
 	Uint8* pixels;
+	const SDL_Rect view { 0, 0, m_res.x, m_res.y };
 
-	if(SDL_LockTexture(m_texture, nullptr, (void**)&pixels, &m_pitch)!=0) {
+	if(SDL_LockTexture(m_texture, &view, (void**)&pixels, &m_pitch)!=0) {
 		fprintf(stderr, "failed: %s\n", SDL_GetError());
 		return;
 	}
 
-	const auto res = GetResolution();
+	const size_t rowSize = m_res.x * sizeof(uint32_t);
 
-	memcpy(pixels, m_buffer, res.y * res.x * sizeof(uint32_t));
+	if (static_cast<size_t>(m_pitch) == rowSize) {
+		memcpy(pixels, m_buffer, m_res.y * rowSize);
+	} else {
+		for (int y = 0; y < m_res.y; ++y)
+			memcpy(pixels + (y * m_pitch), m_buffer + (y * m_res.x), rowSize);
+	}
 
 	SDL_UnlockTexture(m_texture);
-	
-	SDL_RenderCopy(m_rend, m_texture, nullptr, nullptr);
+	Present();
+	m_redraw = false;
+}
+
+
+
+
+// uploads only the changed rows, and presents nothing when none changed
+void SdlRender::DrawRows(const uint64_t rows) noexcept
+{
+	_SDLRENDER_INITIALIZED_ASSERT_();
+	ASSERT_MSG(m_buffer != nullptr, "attempt to draw null buffer");
+
+	if (m_redraw || m_res.y > 64) {
+		DrawBuffer();
+		return;
+	}
+
+	int y = 0;
+
+	// one upload per run of changed rows
+	while (y < m_res.y)
+	{
+		if (!(rows & (uint64_t(1) << y))) {
+			++y;
+			continue;
+		}
+
+		const int first = y;
+		while (y < m_res.y && (rows & (uint64_t(1) << y)))
+			++y;
+
+		const SDL_Rect rect { 0, first, m_res.x, y - first };
+		if (SDL_UpdateTexture(m_texture, &rect, m_buffer + (first * m_res.x), m_res.x * 4) != 0) {
+			fprintf(stderr, "failed: %s\n", SDL_GetError());
+			return;
+		}
+	}
+
+	if (rows != 0)
+		Present();
+}
+
+
+
+
+void SdlRender::Present()
+{
+	SDL_RenderClear(m_rend);
+	const SDL_Rect view { 0, 0, m_res.x, m_res.y };
+	SDL_RenderCopy(m_rend, m_texture, &view, nullptr);
 	SDL_RenderPresent(m_rend);
 }
 
@@ -491,6 +558,8 @@ bool SdlRender::CreateTexture(const int w, const int h)
 
 	SDL_DestroyTexture(m_texture);
 	m_texture = newTexture;
+	m_textureRes = { w, h };
+	m_redraw = true;
 	return true;
 }
 
@@ -505,6 +574,12 @@ bool SdlRender::CreateTexture(const int w, const int h)
 
 
 #ifndef __ANDROID__
+extern "C" XCHIP_EXPORT int XCHIP_PluginVersion()
+{
+	return XCHIP_PLUGIN_INTERFACE_VERSION;
+}
+
+
 extern "C" XCHIP_EXPORT iPlugin* XCHIP_LoadPlugin()
 {
 	return new(std::nothrow) SdlRender();
@@ -359,6 +359,12 @@ void SdlSound::audio_callback(void* userdata, uint8_t* const stream, const int l
 #ifndef __ANDROID__
 // export
 
+extern "C" XCHIP_EXPORT int XCHIP_PluginVersion()
+{
+	return XCHIP_PLUGIN_INTERFACE_VERSION;
+}
+
+
 extern "C" XCHIP_EXPORT iPlugin* XCHIP_LoadPlugin()
 {
 	return new(std::nothrow) SdlSound();
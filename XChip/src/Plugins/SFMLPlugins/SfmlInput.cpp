@@ -206,6 +206,12 @@ void SfmlInput::SetEscapeKeyCallback(const void* arg, EscapeKeyCallback callback
 
 
 
+extern "C" XCHIP_EXPORT int XCHIP_PluginVersion()
+{
+	return XCHIP_PLUGIN_INTERFACE_VERSION;
+}
+
+
 extern "C" XCHIP_EXPORT iPlugin* XCHIP_LoadPlugin()
 {
 	return new(std::nothrow) SfmlInput();
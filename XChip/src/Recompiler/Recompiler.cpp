@@ -0,0 +1,547 @@
+/*
+
+XChipRecompiler - chip8 ROM to C++ static recompiler using XChip.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+
+
+
+/*******************************************************************************************
+ *	XChipRecompiler <rom> <output.cpp>
+ *
+ *	disassembles the ROM following its control flow from 0x200 and
+ *	writes a C++ program with one label per instruction, linked against
+ *	Core and loading the SDL plugins like EmuApp. the recompiled code
+ *	runs as the Emulator STATIC engine, dynamic jumps ( BNNN, 00EE )
+ *	go through a switch on pc. addresses not found by the disassembly
+ *	and ROMs that modify their own code fall back to the interpreter.
+ *******************************************************************************************/
+
+
+namespace {
+
+constexpr size_t romBegin = 0x200;
+constexpr size_t memoryEnd = 0x1000;
+
+
+struct Program
+{
+	std::vector<uint8_t> rom;
+	std::vector<bool> isCode;     // an instruction starts at this address
+	std::vector<bool> codeBytes;  // the byte belongs to an instruction
+};
+
+
+bool load_rom(const char* fileName, std::vector<uint8_t>& rom);
+void find_code(Program& prog);
+void write_program(const Program& prog, const char* romName, std::ostream& out);
+
+}
+
+
+
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		std::cerr << "Usage: " << argv[0] << " <rom> <output.cpp>\n";
+		return EXIT_FAILURE;
+	}
+
+	Program prog;
+
+	if (!load_rom(argv[1], prog.rom))
+		return EXIT_FAILURE;
+
+	find_code(prog);
+
+	std::ofstream out(argv[2]);
+
+	if (!out.good())
+	{
+		std::cerr << "Could not open \'" << argv[2] << "\' for writing\n";
+		return EXIT_FAILURE;
+	}
+
+	write_program(prog, argv[1], out);
+
+	if (!out.good())
+	{
+		std::cerr << "Error writing \'" << argv[2] << "\'\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+
+
+// locals functions definitions
+namespace {
+
+
+bool load_rom(const char* fileName, std::vector<uint8_t>& rom)
+{
+	std::ifstream file(fileName, std::ios::binary);
+
+	if (!file.good())
+	{
+		std::cerr << "Error opening ROM file \'" << fileName << "\'\n";
+		return false;
+	}
+
+	rom.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+	if (rom.empty() || rom.size() > (memoryEnd - romBegin))
+	{
+		std::cerr << "Bad ROM size: " << rom.size() << " bytes\n";
+		return false;
+	}
+
+	return true;
+}
+
+
+
+
+uint16_t read_opcode(const Program& prog, const size_t addr)
+{
+	return prog.rom[addr - romBegin] << 8 | prog.rom[addr - romBegin + 1];
+}
+
+
+bool in_rom(const Program& prog, const size_t addr)
+{
+	return addr >= romBegin && (addr + 1) < (romBegin + prog.rom.size());
+}
+
+
+bool is_skip(const uint16_t op)
+{
+	const auto msn = op >> 12;
+	return msn == 0x3 || msn == 0x4 || (msn == 0x5 && (op & 0xf) == 0)
+	    || (msn == 0x9 && (op & 0xf) == 0)
+	    || (msn == 0xE && ((op & 0xff) == 0x9E || (op & 0xff) == 0xA1));
+}
+
+
+// FX33 and FX55 write memory at I
+bool writes_memory(const uint16_t op)
+{
+	return (op & 0xf0ff) == 0xF033 || (op & 0xf0ff) == 0xF055;
+}
+
+
+// true for the opcodes the interpreter knows
+bool is_valid(const uint16_t op)
+{
+	switch (op >> 12)
+	{
+		case 0x0:
+			return op == 0x00E0 || op == 0x00EE || (op >= 0x00FB && op <= 0x00FF)
+			    || (op & 0xfff0) == 0x00C0;
+
+		case 0x5: case 0x9: return (op & 0xf) == 0;
+		case 0x8: return (op & 0xf) <= 0x7 || (op & 0xf) == 0xE;
+		case 0xE: return (op & 0xff) == 0x9E || (op & 0xff) == 0xA1;
+		case 0xF:
+			switch (op & 0xff)
+			{
+				case 0x07: case 0x0A: case 0x15: case 0x18: case 0x1E: case 0x29:
+				case 0x30: case 0x33: case 0x55: case 0x65: case 0x75: case 0x85:
+					return true;
+			}
+			return false;
+	}
+
+	return true;
+}
+
+
+
+
+// recursive descent from 0x200: follows jumps, calls and both
+// sides of the skips. indirect jumps ( BNNN ) and returns are
+// not followed, their targets are found as call return addresses
+// or left to the interpreter.
+void find_code(Program& prog)
+{
+	const size_t memSize = romBegin + prog.rom.size();
+	prog.isCode.assign(memSize, false);
+	prog.codeBytes.assign(memSize, false);
+
+	std::vector<size_t> pending { romBegin };
+
+	while (!pending.empty())
+	{
+		size_t addr = pending.back();
+		pending.pop_back();
+
+		while (in_rom(prog, addr) && !prog.isCode[addr])
+		{
+			const uint16_t op = read_opcode(prog, addr);
+			prog.isCode[addr] = true;
+			prog.codeBytes[addr] = prog.codeBytes[addr + 1] = true;
+
+			if (!is_valid(op) || op == 0x00EE || op == 0x00FD || (op >> 12) == 0xB)
+				break;
+
+			if ((op >> 12) == 0x1) {
+				addr = op & 0x0fff;
+				continue;
+			}
+
+			if ((op >> 12) == 0x2)
+				pending.push_back(op & 0x0fff);
+			else if (is_skip(op))
+				pending.push_back(addr + 4);
+
+			addr += 2;
+		}
+	}
+}
+
+
+
+
+std::string hex(const size_t value, const int digits = 3)
+{
+	char buffer[24];
+	std::snprintf(buffer, sizeof(buffer), "0x%0*zX", digits, value);
+	return buffer;
+}
+
+
+std::string label(const size_t addr)
+{
+	char buffer[24];
+	std::snprintf(buffer, sizeof(buffer), "l_%03zX", addr);
+	return buffer;
+}
+
+
+// direct goto when the target is recompiled, the dispatcher otherwise
+std::string jump_to(const Program& prog, const size_t addr)
+{
+	if (addr < prog.isCode.size() && prog.isCode[addr])
+		return "goto " + label(addr) + ";";
+
+	return "{ cpuMan.SetPC(" + hex(addr) + "); goto l_dispatch; }";
+}
+
+
+// the opcodes with a few lines of C++ , the other ones call
+// their handler in Core with the opcode and pc written back.
+bool write_inline(const Program& prog, const size_t addr, const uint16_t op, std::ostream& out)
+{
+	const std::string vx = "v[" + hex(op >> 8 & 0xf, 1) + "]";
+	const std::string vy = "v[" + hex(op >> 4 & 0xf, 1) + "]";
+	const std::string nn = hex(op & 0xff, 2);
+	const std::string nnn = hex(op & 0xfff);
+	const size_t next = addr + 2;
+
+	if (!is_valid(op))
+		return false;
+
+	switch (op >> 12)
+	{
+		case 0x0:
+			if (op != 0x00EE)
+				return false;
+			out << "\tcpuMan.SetSP(cpuMan.GetSP() - 1);\n"
+			    << "\tcpuMan.SetPC(cpuMan.GetStack(cpuMan.GetSP() & 0xF));\n"
+			    << "\tgoto l_dispatch;\n";
+			return true;
+
+		case 0x1: out << '\t' << jump_to(prog, op & 0xfff) << '\n'; return true;
+		case 0x2:
+			out << "\tcpuMan.GetStack(cpuMan.GetSP() & 0xF) = " << hex(next) << ";\n"
+			    << "\tcpuMan.SetSP(cpuMan.GetSP() + 1);\n"
+			    << '\t' << jump_to(prog, op & 0xfff) << '\n';
+			return true;
+
+		case 0x3: out << "\tif (" << vx << " == " << nn << ") " << jump_to(prog, next + 2) << '\n'; break;
+		case 0x4: out << "\tif (" << vx << " != " << nn << ") " << jump_to(prog, next + 2) << '\n'; break;
+		case 0x5: out << "\tif (" << vx << " == " << vy << ") " << jump_to(prog, next + 2) << '\n'; break;
+		case 0x9: out << "\tif (" << vx << " != " << vy << ") " << jump_to(prog, next + 2) << '\n'; break;
+		case 0x6: out << '\t' << vx << " = " << nn << ";\n"; break;
+		case 0x7: out << '\t' << vx << " += " << nn << ";\n"; break;
+		case 0xA: out << "\tcpuMan.SetIndexRegister(" << nnn << ");\n"; break;
+		case 0xB:
+			out << "\tcpuMan.SetPC(" << nnn << " + v[0]);\n"
+			    << "\tgoto l_dispatch;\n";
+			return true;
+
+		// VX is read again after VF is set, like the op_8XYx handlers
+		case 0x8:
+			switch (op & 0xf)
+			{
+				case 0x0: out << '\t' << vx << " = " << vy << ";\n"; break;
+				case 0x1: out << '\t' << vx << " |= " << vy << ";\n"; break;
+				case 0x2: out << '\t' << vx << " &= " << vy << ";\n"; break;
+				case 0x3: out << '\t' << vx << " ^= " << vy << ";\n"; break;
+				case 0x4:
+					out << "\t{ const uint16_t r = " << vx << " + " << vy << "; v[0xF] = r > 0xff; "
+					    << vx << " = r & 0xff; }\n";
+					break;
+				case 0x5:
+					out << "\t{ const uint8_t vy = " << vy << "; v[0xF] = vy > " << vx << " ? 0 : 1; "
+					    << vx << " -= vy; }\n";
+					break;
+				case 0x6: out << "\tv[0xF] = " << vx << " & 0x1; " << vx << " >>= 1;\n"; break;
+				case 0x7:
+					out << "\t{ const uint8_t vy = " << vy << "; v[0xF] = " << vx << " > vy ? 0 : 1; "
+					    << vx << " = vy - " << vx << "; }\n";
+					break;
+				case 0xE: out << "\tv[0xF] = (" << vx << " & 0x80) != 0; " << vx << " <<= 1;\n"; break;
+			}
+			break;
+
+		case 0xF:
+			switch (op & 0xff)
+			{
+				case 0x07: out << '\t' << vx << " = cpuMan.GetDelayTimer();\n"; break;
+				case 0x15: out << "\tcpuMan.SetDelayTimer(" << vx << ");\n"; break;
+				case 0x1E: out << "\tcpuMan.SetIndexRegister(cpuMan.GetIndexRegister() + " << vx << ");\n"; break;
+				case 0x29: out << "\tcpuMan.SetIndexRegister(cpuMan.GetDefaultFontIndex() + " << vx << " * 5);\n"; break;
+				case 0x30: out << "\tcpuMan.SetIndexRegister(cpuMan.GetHiResFontIndex() + " << vx << " * 10);\n"; break;
+				default: return false;
+			}
+			break;
+
+		default: return false;
+	}
+
+	if (next < prog.isCode.size() && prog.isCode[next])
+		return true;
+
+	out << '\t' << jump_to(prog, next) << '\n';
+	return true;
+}
+
+
+
+
+const char* handler_name(const uint16_t op)
+{
+	static const char* const primary[16] =
+	{
+		"op_0xxx", "op_1NNN", "op_2NNN", "op_3XNN",
+		"op_4XNN", "op_5XY0", "op_6XNN", "op_7XNN",
+		"op_8XYx", "op_9XY0", "op_ANNN", "op_BNNN",
+		"op_CXNN", "op_DXYN_ex", "op_EXxx", "op_FXxx"
+	};
+
+	return is_valid(op) ? primary[op >> 12] : "UnknownOpcode";
+}
+
+
+void write_call(const Program& prog, const size_t addr, const uint16_t op, std::ostream& out)
+{
+	const size_t next = addr + 2;
+
+	out << "\tcpuMan.SetOpcode(" << hex(op, 4) << ");\n"
+	    << "\tcpuMan.SetPC(" << hex(next) << ");\n"
+	    << '\t' << handler_name(op) << "(cpuMan);\n";
+
+	if (writes_memory(op))
+	{
+		const size_t size = (op & 0xff) == 0x33 ? 3 : (op >> 8 & 0xf) + 1;
+		out << "\tif (code_changed(cpuMan, cpuMan.GetIndexRegister(), " << size << "))\n"
+		    << "\t\treturn done;\n";
+	}
+
+	out << "\tif (cpuMan.GetPC() != " << hex(next) << " || cpuMan.GetFlags(Cpu::EXIT))\n"
+	    << "\t\tgoto l_dispatch;\n";
+
+	if (next >= prog.isCode.size() || !prog.isCode[next])
+		out << "\tgoto l_dispatch;\n";
+}
+
+
+
+
+void write_bytes(const std::vector<uint8_t>& bytes, std::ostream& out)
+{
+	for (size_t i = 0; i < bytes.size(); ++i)
+		out << ((i % 16) == 0 ? "\n\t" : " ") << hex(bytes[i], 2) << ',';
+
+	out << '\n';
+}
+
+
+void write_run_static(const Program& prog, std::ostream& out)
+{
+	out << "// runs up to 'count' instructions, each instruction has a label and\n"
+	    << "// checks the budget. pc is only written back to cpuMan on exits and\n"
+	    << "// before calling a handler.\n"
+	    << "size_t run_static(CpuManager& cpuMan, const size_t count)\n"
+	    << "{\n"
+	    << "\tuint8_t* const v = cpuMan.GetRegisters();\n"
+	    << "\tsize_t done = 0;\n\n"
+	    << "\tif (codeModified)\n"
+	    << "\t\treturn 0;\n\n"
+	    << "l_dispatch:\n"
+	    << "\tif (cpuMan.GetFlags(Cpu::EXIT))\n"
+	    << "\t\treturn done;\n\n"
+	    << "\tswitch (cpuMan.GetPC())\n"
+	    << "\t{\n";
+
+	for (size_t addr = romBegin; addr < prog.isCode.size(); ++addr)
+		if (prog.isCode[addr])
+			out << "\t\tcase " << hex(addr) << ": goto " << label(addr) << ";\n";
+
+	out << "\t\tdefault: return done;\n"
+	    << "\t}\n\n";
+
+	for (size_t addr = romBegin; addr < prog.isCode.size(); ++addr)
+	{
+		if (!prog.isCode[addr])
+			continue;
+
+		const uint16_t op = read_opcode(prog, addr);
+
+		out << '\n' << label(addr) << ": // " << hex(op, 4) << '\n'
+		    << "\tif (done == count) {\n"
+		    << "\t\tcpuMan.SetPC(" << hex(addr) << ");\n"
+		    << "\t\treturn done;\n"
+		    << "\t}\n"
+		    << "\t++done;\n";
+
+		if (!write_inline(prog, addr, op, out))
+			write_call(prog, addr, op, out);
+	}
+
+	out << "}\n\n\n";
+}
+
+
+
+
+void write_program(const Program& prog, const char* romName, std::ostream& out)
+{
+	std::vector<uint8_t> codeMap(prog.rom.size());
+	for (size_t i = 0; i < prog.rom.size(); ++i)
+		codeMap[i] = prog.codeBytes[romBegin + i];
+
+	out << "// generated by XChipRecompiler from \'" << romName << "\', do not edit.\n\n"
+	    << "#include <cstdlib>\n"
+	    << "#include <iostream>\n"
+	    << "#include <utility>\n"
+	    << "#include <Utix/Log.h>\n"
+	    << "#include <Utix/Common.h>\n"
+	    << "#include <XChip/Core/Emulator.h>\n\n\n"
+	    << "using namespace xchip;\n"
+	    << "using namespace xchip::instructions;\n\n"
+	    << "namespace {\n\n"
+	    << "constexpr size_t romBegin = " << hex(romBegin) << ";\n"
+	    << "constexpr size_t romEnd = " << hex(romBegin + prog.rom.size()) << ";\n\n"
+	    << "const uint8_t rom[] =\n{";
+
+	write_bytes(prog.rom, out);
+
+	out << "};\n\n"
+	    << "bool codeModified = false;\n\n\n";
+
+	// the write check is only emitted for ROMs with FX33 / FX55,
+	// unused it would warn in the generated code
+	bool writes = false;
+	for (size_t addr = romBegin; addr < prog.isCode.size() && !writes; ++addr)
+		writes = prog.isCode[addr] && writes_memory(read_opcode(prog, addr));
+
+	if (writes)
+	{
+		out << "// 1 for the bytes of the recompiled instructions\n"
+		    << "const uint8_t codeMap[] =\n{";
+
+		write_bytes(codeMap, out);
+
+		out << "};\n\n\n"
+		    << "// true when a write changed a recompiled instruction, from\n"
+		    << "// then on the interpreter runs the ROM.\n"
+		    << "bool code_changed(const CpuManager& cpuMan, const size_t at, const size_t size)\n"
+		    << "{\n"
+		    << "\tfor (size_t addr = at; addr < (at + size) && addr < romEnd; ++addr)\n"
+		    << "\t{\n"
+		    << "\t\tif (addr >= romBegin && codeMap[addr - romBegin] && cpuMan.GetMemory(addr) != rom[addr - romBegin])\n"
+		    << "\t\t\tcodeModified = true;\n"
+		    << "\t}\n\n"
+		    << "\treturn codeModified;\n"
+		    << "}\n\n\n";
+	}
+
+	write_run_static(prog, out);
+
+	out << "}\n\n\n\n"
+	    << "static Emulator g_emulator;\n\n"
+	    << "int main()\n"
+	    << "{\n"
+	    << "#ifdef _WIN32\n"
+	    << "\tconst std::string pluginPath = utix::GetFullProcDir() + \"plugins\\\\\";\n"
+	    << "\tconst std::string pluginExt = \".dll\";\n"
+	    << "#else\n"
+	    << "\tconst std::string pluginPath = utix::GetFullProcDir() + \"plugins/\";\n"
+	    << "\tconst std::string pluginExt = \"\";\n"
+	    << "#endif\n\n"
+	    << "\tUniqueRender render;\n"
+	    << "\tUniqueInput input;\n"
+	    << "\tUniqueSound sound;\n\n"
+	    << "\tif (!render.Load(pluginPath + \"XChipSDLRender\" + pluginExt)\n"
+	    << "\t    || !input.Load(pluginPath + \"XChipSDLInput\" + pluginExt)\n"
+	    << "\t    || !sound.Load(pluginPath + \"XChipSDLSound\" + pluginExt)\n"
+	    << "\t    || !g_emulator.Initialize(std::move(render), std::move(input), std::move(sound))\n"
+	    << "\t    || !g_emulator.LoadRom(rom, sizeof(rom)))\n"
+	    << "\t{\n"
+	    << "\t\tstd::cerr << utix::GetLastLogError() << '\\n';\n"
+	    << "\t\treturn EXIT_FAILURE;\n"
+	    << "\t}\n\n"
+	    << "\tg_emulator.SetStaticCode(run_static);\n\n"
+	    << "\tif (!g_emulator.SetEngine(ExecEngine::STATIC))\n"
+	    << "\t\treturn EXIT_FAILURE;\n\n"
+	    << "\tPacer pacer;\n"
+	    << "\tpacer.SetTargetHz(60);\n"
+	    << "\tpacer.Start();\n\n"
+	    << "\t// one 60 hz frame per loop, run_static runs the whole frame budget\n"
+	    << "\twhile (!g_emulator.GetExitFlag())\n"
+	    << "\t{\n"
+	    << "\t\tif (g_emulator.GetRender()->UpdateEvents())\n"
+	    << "\t\t\tg_emulator.Refresh();\n\n"
+	    << "\t\tg_emulator.GetInput()->UpdateKeys();\n"
+	    << "\t\tg_emulator.RunFrame();\n\n"
+	    << "\t\tif (g_emulator.GetDrawFlag())\n"
+	    << "\t\t\tg_emulator.Draw();\n\n"
+	    << "\t\tpacer.Wait();\n"
+	    << "\t}\n\n"
+	    << "\treturn EXIT_SUCCESS;\n"
+	    << "}\n";
+}
+
+
+
+
+}
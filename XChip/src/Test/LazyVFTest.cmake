@@ -0,0 +1,16 @@
+# runs XChipStateHash of the eager and the lazy VF builds on the
+# same programs, fails if any hash differs. ROMS is | separated.
+string(REPLACE "|" ";" ROMS "${ROMS}")
+
+execute_process(COMMAND ${EAGER} ${ROMS} RESULT_VARIABLE EAGER_RESULT OUTPUT_VARIABLE EAGER_HASHES)
+execute_process(COMMAND ${LAZY} ${ROMS} RESULT_VARIABLE LAZY_RESULT OUTPUT_VARIABLE LAZY_HASHES)
+
+if(NOT EAGER_RESULT EQUAL 0 OR NOT LAZY_RESULT EQUAL 0)
+	message(FATAL_ERROR "XChipStateHash failed: eager ${EAGER_RESULT}, lazy ${LAZY_RESULT}")
+endif()
+
+if(NOT EAGER_HASHES STREQUAL LAZY_HASHES)
+	message(FATAL_ERROR "lazy VF states differ\neager:\n${EAGER_HASHES}\nlazy:\n${LAZY_HASHES}")
+endif()
+
+message("${EAGER_HASHES}")
@@ -0,0 +1,157 @@
+/*
+
+XChip - A chip8 lib and emulator.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+
+
+// checks that the emulator doesn't allocate once Emulator::Initialize
+// returned: a ROM toggling 00FE / 00FF and drawing runs on every engine
+// while operator new and the malloc family are counted.
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <XChip/Core.h>
+
+using namespace xchip;
+
+static bool g_counting = false;
+static unsigned long g_allocs = 0;
+
+
+
+
+void* operator new(std::size_t size)
+{
+	if (g_counting)
+		++g_allocs;
+
+	void* const ptr = std::malloc(size ? size : 1);
+	if (!ptr)
+		std::abort();
+
+	return ptr;
+}
+
+
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return operator new(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return operator new(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+
+
+
+// glibc exports its allocator under these names, the malloc family
+// is replaced to count the C allocations too.
+#if defined(__GLIBC__)
+extern "C" {
+
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void __libc_free(void*);
+
+void* malloc(size_t size)
+{
+	if (g_counting)
+		++g_allocs;
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+	if (g_counting)
+		++g_allocs;
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+	if (g_counting)
+		++g_allocs;
+	return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr)
+{
+	if (g_counting && ptr)
+		++g_allocs;
+	__libc_free(ptr);
+}
+
+}
+#endif
+
+
+
+
+// 00FF, A000, D015, 00C4, 00FB, 00FE, D015, 00FC, 00E0, 1200
+static const uint8_t toggleRom[] = {
+	0x00, 0xFF, 0xA0, 0x00, 0xD0, 0x15, 0x00, 0xC4, 0x00, 0xFB,
+	0x00, 0xFE, 0xD0, 0x15, 0x00, 0xFC, 0x00, 0xE0, 0x12, 0x00
+};
+
+
+static const struct { ExecEngine engine; const char* name; } engines[] = {
+	{ ExecEngine::INTERPRETER, "INTERPRETER" },
+	{ ExecEngine::THREADED, "THREADED" },
+	{ ExecEngine::JIT, "JIT" },
+	{ ExecEngine::FUSED, "FUSED" }
+};
+
+
+
+
+int main()
+{
+	int failures = 0;
+
+	for (const auto& engine : engines)
+	{
+		Emulator emulator;
+		if (!emulator.InitializeHeadless() || !emulator.SetEngine(engine.engine)
+		     || !emulator.LoadRom(toggleRom, sizeof(toggleRom))) 
+		{
+			std::printf("%s: cannot set up the emulator\n", engine.name);
+			++failures;
+			continue;
+		}
+
+		g_allocs = 0;
+		g_counting = true;
+
+		for (int frame = 0; frame < 600; ++frame) 
+		{
+			emulator.RunFrame();
+			if (emulator.GetDrawFlag())
+				emulator.Draw();
+		}
+
+		g_counting = false;
+
+		std::printf("%s: %lu allocations\n", engine.name, g_allocs);
+		if (g_allocs != 0)
+			++failures;
+	}
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,213 @@
+/*
+
+XChip - A chip8 lib and emulator.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+
+
+// checks that the SSE2 and AVX2 GfxKernels give the same planes, gfx,
+// collisions and compares as the scalar ones on random planes, lo and 
+// hi res.
+// with --bench it also prints the time of each kernel per call.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <initializer_list>
+#include <XChip/Core/GfxKernels.h>
+
+using namespace xchip;
+
+// local functions declarations
+static int check_kernels(const GfxKernels& scalar, const GfxKernels& kernels);
+static void bench_kernels(const GfxKernels& kernels);
+static void random_plane(uint64_t* plane, const int rows, const int width);
+static uint64_t random_word();
+
+static constexpr int maxRows = 64;
+static constexpr int checkRuns = 20000;
+static constexpr int benchCalls = 2000000;
+static uint64_t g_seed = 0x9E3779B97F4A7C15ULL;
+static volatile uint64_t g_sink;
+
+
+
+
+int main(int argc, char** argv)
+{
+	const bool bench = argc > 1 && std::strcmp(argv[1], "--bench") == 0;
+	const GfxKernels& scalar = *FindGfxKernels(GfxKernels::SCALAR);
+	int failures = 0;
+
+	for (const auto level : { GfxKernels::SSE2, GfxKernels::AVX2 })
+	{
+		const GfxKernels* const kernels = FindGfxKernels(level);
+		if (kernels == nullptr) {
+			std::printf("level %d: not supported, skipped\n", level);
+			continue;
+		}
+
+		const int mismatches = check_kernels(scalar, *kernels);
+		std::printf("%s: %d mismatches\n", kernels->name, mismatches);
+		failures += mismatches;
+	}
+
+	if (bench)
+	{
+		for (const auto level : { GfxKernels::SCALAR, GfxKernels::SSE2, GfxKernels::AVX2 })
+		{
+			if (const GfxKernels* const kernels = FindGfxKernels(level))
+				bench_kernels(*kernels);
+		}
+	}
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+
+
+// runs each kernel on a copy of the same random plane, odd row
+// counts too, they take the tail paths of the wide versions.
+static int check_kernels(const GfxKernels& scalar, const GfxKernels& kernels)
+{
+	uint64_t expected[maxRows * 2], result[maxRows * 2], sprite[32];
+	uint32_t expectedGfx[maxRows * 128], resultGfx[maxRows * 128];
+	int mismatches = 0;
+
+	for (int run = 0; run < checkRuns; ++run)
+	{
+		const int width = (run & 1) ? 128 : 64;
+		const int rows = (run % 5) == 4 ? (width / 2) - 1 : width / 2;
+		bool expectedHit = false, resultHit = false;
+
+		random_plane(expected, rows, width);
+		std::memcpy(result, expected, sizeof(expected));
+
+		switch ((run / 2) % 7)
+		{
+			case 0: scalar.clear(expected, rows); kernels.clear(result, rows); break;
+			case 1: scalar.scrollRight(expected, rows, width); kernels.scrollRight(result, rows, width); break;
+			case 2: scalar.scrollLeft(expected, rows, width); kernels.scrollLeft(result, rows, width); break;
+
+			case 3: {
+				const int lines = random_word() % 16;
+				scalar.scrollDown(expected, rows, lines); 
+				kernels.scrollDown(result, rows, lines); 
+				break;
+			}
+
+			// sprites wrap on the power of 2 heights only
+			case 4: {
+				const int height = random_word() % 17;
+				const int y = random_word() % (width / 2);
+				random_plane(sprite, 16, width);
+				expectedHit = scalar.xorSprite(expected, width / 2, sprite, y, height);
+				resultHit = kernels.xorSprite(result, width / 2, sprite, y, height);
+				break;
+			}
+
+			// equal planes half of the times, else one bit differs
+			case 5: {
+				uint64_t other[maxRows * 2];
+				std::memcpy(other, expected, sizeof(other));
+				if ((run / 14) % 2)
+					other[random_word() % (rows * 2)] ^= uint64_t(1) << (random_word() % 64);
+
+				expectedHit = scalar.compare(expected, other, rows);
+				resultHit = kernels.compare(result, other, rows);
+				break;
+			}
+
+			default:
+				scalar.expand(expected, expectedGfx, rows, width);
+				kernels.expand(result, resultGfx, rows, width);
+				if (std::memcmp(expectedGfx, resultGfx, rows * width * sizeof(uint32_t)) != 0)
+					++mismatches;
+				break;
+		}
+
+		if (expectedHit != resultHit || std::memcmp(expected, result, rows * 2 * sizeof(uint64_t)) != 0)
+			++mismatches;
+	}
+
+	return mismatches;
+}
+
+
+
+
+// hi res plane, the sprite and the scroll moves change every call
+static void bench_kernels(const GfxKernels& kernels)
+{
+	using clock = std::chrono::steady_clock;
+	static uint64_t plane[maxRows * 2], other[maxRows * 2], sprite[32];
+	static uint32_t gfx[maxRows * 128];
+
+	random_plane(plane, maxRows, 128);
+	random_plane(sprite, 16, 128);
+
+	const char* const names[] = { "clear", "scrollRight", "scrollLeft", "scrollDown", "xorSprite", "compare", "expand" };
+
+	for (int kernel = 0; kernel < 7; ++kernel)
+	{
+		// equal planes, the compare reads them to the end
+		std::memcpy(other, plane, sizeof(plane));
+		const auto begin = clock::now();
+
+		for (int i = 0; i < benchCalls; ++i)
+		{
+			switch (kernel)
+			{
+				case 0: kernels.clear(plane, maxRows); break;
+				case 1: kernels.scrollRight(plane, maxRows, 128); break;
+				case 2: kernels.scrollLeft(plane, maxRows, 128); break;
+				case 3: kernels.scrollDown(plane, maxRows, 1 + (i & 3)); break;
+				case 4: g_sink = kernels.xorSprite(plane, maxRows, sprite, i & (maxRows - 1), 16); break;
+				case 5: g_sink = kernels.compare(plane, other, maxRows); break;
+				default: kernels.expand(plane, gfx, maxRows, 128); break;
+			}
+		}
+
+		const double nsecs = std::chrono::duration<double, std::nano>(clock::now() - begin).count();
+		g_sink = plane[0] ^ gfx[0];
+		std::printf("%-6s %-12s %8.2f ns\n", kernels.name, names[kernel], nsecs / benchCalls);
+	}
+}
+
+
+
+
+// lo res rows only use the first word
+static void random_plane(uint64_t* plane, const int rows, const int width)
+{
+	for (int y = 0; y < rows; ++y, plane += 2) {
+		plane[0] = random_word();
+		plane[1] = width > 64 ? random_word() : 0;
+	}
+}
+
+
+// xorshift64
+static uint64_t random_word()
+{
+	g_seed ^= g_seed << 13;
+	g_seed ^= g_seed >> 7;
+	g_seed ^= g_seed << 17;
+	return g_seed;
+}
@@ -0,0 +1,189 @@
+/*
+
+XChip - A chip8 lib and emulator.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+
+
+// the throughput of ExecuteInstruction, and its L1 i-cache misses where
+// the perf events are available. XChipOpcodeBench builds it against 
+// a Core with the decoded instruction cache and one with the OPCODE_TABLE
+// handlers. runs the ROMs given as arguments and a built in loop.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <XChip/Core.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace xchip;
+
+// local functions declarations
+static void reset(CpuManager& manager);
+static void bench(CpuManager& manager, const char* name);
+static int open_icache_counter();
+static long long read_counter(const int counter);
+
+static constexpr size_t warmupInstrs = 1000000;
+static constexpr size_t benchInstrs = 50000000;
+
+// V0 counts to 255 adding V1 into V2 with carry, then redraws a sprite
+static const uint8_t loopRom[] = {
+	0x60, 0x00, 0x61, 0x03, 0x62, 0x00, 0x82, 0x14, // 6000 6103 6200 8214
+	0x3F, 0x00, 0x72, 0x01, 0x70, 0x01, 0x30, 0xFF, // 3F00 7201 7001 30FF
+	0x12, 0x06, 0xA0, 0x00, 0xD0, 0x15, 0x12, 0x00  // 1206 A000 D015 1200
+};
+
+
+
+
+int main(int argc, char** argv)
+{
+	HeadlessRender render;
+	HeadlessInput input;
+	HeadlessSound sound;
+	CpuManager manager;
+
+	if (!manager.SetMemory(0x10000) || !manager.SetGfxRes(64, 32)
+	     || !render.Initialize({512, 256}, CpuManager::GetMaxGfxRes()) 
+	     || !input.Initialize() || !sound.Initialize())
+	{
+		return EXIT_FAILURE;
+	}
+
+	render.SetBuffer(manager.GetGfx());
+	manager.SetRender(&render);
+	manager.SetInput(&input);
+	manager.SetSound(&sound);
+
+#if defined(XCHIP_OPCODE_TABLE)
+	std::printf("OPCODE_TABLE: %zu bytes of handler pointers\n", sizeof(instructions::InstrTable) * 0x10000);
+#else
+	std::printf("decoded cache: %zu bytes per address\n", sizeof(DecodedInstr));
+#endif
+
+	for (int i = 1; i < argc; ++i)
+	{
+		reset(manager);
+		if (!manager.LoadRom(argv[i], 0x200))
+			return EXIT_FAILURE;
+
+		bench(manager, argv[i]);
+	}
+
+	reset(manager);
+	if (!manager.LoadRom(loopRom, sizeof(loopRom), 0x200))
+		return EXIT_FAILURE;
+
+	bench(manager, "loop");
+	return EXIT_SUCCESS;
+}
+
+
+
+
+static void reset(CpuManager& manager)
+{
+	manager.CleanMemory();
+	manager.CleanRegisters();
+	manager.CleanStack();
+	manager.CleanGfx();
+	manager.CleanFlags();
+	manager.SetGfxRes(64, 32);
+	manager.SetRandSeed(0);
+	manager.SetPC(0x200);
+	manager.LoadDefaultFont();
+	manager.LoadHiResFont();
+}
+
+
+
+
+static void bench(CpuManager& manager, const char* name)
+{
+	using clock = std::chrono::steady_clock;
+
+	for (size_t i = 0; i < warmupInstrs && !manager.GetFlags(Cpu::EXIT); ++i)
+		instructions::ExecuteInstruction(manager);
+
+	const int counter = open_icache_counter();
+	const auto begin = clock::now();
+
+	size_t done = 0;
+	for (; done < benchInstrs && !manager.GetFlags(Cpu::EXIT); ++done)
+		instructions::ExecuteInstruction(manager);
+
+	const auto end = clock::now();
+	const long long misses = read_counter(counter);
+	const double secs = std::chrono::duration<double>(end - begin).count();
+
+	std::printf("%s: %.1f MIPS", name, secs > 0 ? done / secs / 1e6 : 0.0);
+	if (misses >= 0 && done > 0)
+		std::printf(", %.3f i-cache misses per 1000 instructions", misses * 1000.0 / done);
+
+	std::printf("\n");
+}
+
+
+
+
+// -1 when the L1 i-cache misses can't be counted
+static int open_icache_counter()
+{
+#if defined(__linux__)
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_L1I | (PERF_COUNT_HW_CACHE_OP_READ << 8) 
+	            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+	return -1;
+#endif
+}
+
+
+
+
+static long long read_counter(const int counter)
+{
+	long long count = -1;
+
+#if defined(__linux__)
+	if (counter >= 0) 
+	{
+		if (read(counter, &count, sizeof(count)) != sizeof(count))
+			count = -1;
+
+		close(counter);
+	}
+#else
+	(void) counter;
+#endif
+
+	return count;
+}
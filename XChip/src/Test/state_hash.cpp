@@ -0,0 +1,200 @@
+/*
+
+XChip - A chip8 lib and emulator.
+Copyright (C) 2016  Rafael Moura
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
+
+*/
+
+
+
+// prints a hash of the cpu states a set of programs go through, the
+// LazyVFTest compares the hashes of the eager and the lazy VF builds.
+// runs the ROM files given as arguments and built in random programs 
+// mixing the 8XY4 - 8XYE operations with the VF readers.
+#include <cstdio>
+#include <cstdlib>
+#include <XChip/Core.h>
+
+using namespace xchip;
+
+// local functions declarations
+static void reset(CpuManager& manager);
+static uint64_t run_program(CpuManager& manager, const size_t instrs);
+static uint64_t hash_state(CpuManager& manager, uint64_t hash);
+static uint64_t hash_bytes(uint64_t hash, const void* data, const size_t size);
+static size_t make_program(uint8_t* program, const size_t size, uint32_t seed);
+
+static constexpr size_t programInstrs = 2000000;
+static constexpr size_t builtinPrograms = 16;
+
+
+
+
+int main(int argc, char** argv)
+{
+	HeadlessRender render;
+	HeadlessInput input;
+	HeadlessSound sound;
+	CpuManager manager;
+
+	if (!manager.SetMemory(0x10000) || !manager.SetGfxRes(64, 32)
+	     || !render.Initialize({512, 256}, CpuManager::GetMaxGfxRes()) 
+	     || !input.Initialize() || !sound.Initialize())
+	{
+		return EXIT_FAILURE;
+	}
+
+	render.SetBuffer(manager.GetGfx());
+	manager.SetRender(&render);
+	manager.SetInput(&input);
+	manager.SetSound(&sound);
+
+	for (int i = 1; i < argc; ++i)
+	{
+		reset(manager);
+		if (!manager.LoadRom(argv[i], 0x200))
+			return EXIT_FAILURE;
+
+		std::printf("%s %016llx\n", argv[i], (unsigned long long) run_program(manager, programInstrs));
+	}
+
+	uint8_t program[0x400];
+	for (uint32_t seed = 1; seed <= builtinPrograms; ++seed)
+	{
+		reset(manager);
+		const size_t size = make_program(program, sizeof(program), seed);
+		if (!manager.LoadRom(program, size, 0x200))
+			return EXIT_FAILURE;
+
+		std::printf("program %u %016llx\n", seed, (unsigned long long) run_program(manager, programInstrs));
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+
+
+// a clean machine, the same on every program
+static void reset(CpuManager& manager)
+{
+	manager.CleanMemory();
+	manager.CleanRegisters();
+	manager.CleanStack();
+	manager.CleanGfx();
+	manager.CleanFlags();
+	manager.SetGfxRes(64, 32);
+	manager.SetRandSeed(0);
+	manager.SetPC(0x200);
+	manager.LoadDefaultFont();
+	manager.LoadHiResFont();
+}
+
+
+
+
+// the delay timer ticks every 10 instructions, the state is
+// hashed every 5000.
+static uint64_t run_program(CpuManager& manager, const size_t instrs)
+{
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (size_t i = 1; i <= instrs && !manager.GetFlags(Cpu::EXIT); ++i)
+	{
+		instructions::ExecuteInstruction(manager);
+
+		if ((i % 10) == 0 && manager.GetDelayTimer())
+			manager.SetDelayTimer(manager.GetDelayTimer() - 1);
+
+		if ((i % 5000) == 0)
+			hash = hash_state(manager, hash);
+	}
+
+	return hash_state(manager, hash);
+}
+
+
+
+
+static uint64_t hash_state(CpuManager& manager, uint64_t hash)
+{
+	const uint16_t regs[] = {
+		static_cast<uint16_t>(manager.GetPC()), static_cast<uint16_t>(manager.GetIndexRegister()),
+		static_cast<uint16_t>(manager.GetSP()), manager.GetDelayTimer(), manager.GetSoundTimer()
+	};
+
+	manager.ExpandGfx();
+	hash = hash_bytes(hash, regs, sizeof(regs));
+	hash = hash_bytes(hash, manager.GetRegisters(), manager.GetRegistersSize());
+	hash = hash_bytes(hash, manager.GetStack(), manager.GetStackSize() * sizeof(uint16_t));
+	hash = hash_bytes(hash, manager.GetMemory(), manager.GetMemorySize());
+	return hash_bytes(hash, manager.GetGfx(), manager.GetGfxSize() * sizeof(uint32_t));
+}
+
+
+
+
+// FNV-1a
+static uint64_t hash_bytes(uint64_t hash, const void* data, const size_t size)
+{
+	const auto* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+
+	return hash;
+}
+
+
+
+
+// random 8XYx, 6XNN, 7XNN, skips and FX33 / FX55 / FX65 on a scratch
+// area, looping back to the start. every operation which sets VF is
+// followed by a random reader of it at times.
+static size_t make_program(uint8_t* program, const size_t size, uint32_t seed)
+{
+	static const uint16_t aluOps[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE };
+	const auto next = [&seed]() { seed = seed * 1103515245 + 12345; return seed >> 16; };
+	size_t pos = 0;
+
+	const auto emit = [&](const uint16_t opcode) {
+		program[pos++] = static_cast<uint8_t>(opcode >> 8);
+		program[pos++] = static_cast<uint8_t>(opcode);
+	};
+
+	// I points to the scratch area after the program
+	emit(0xA000 | (0x200 + size));
+
+	while (pos < (size - 4))
+	{
+		const uint16_t x = next() & 0xf;
+		const uint16_t y = next() & 0xf;
+		const uint16_t nn = next() & 0xff;
+
+		switch (next() % 8)
+		{
+			case 0: emit(0x6000 | x << 8 | nn); break;
+			case 1: emit(0x7000 | x << 8 | nn); break;
+			case 2: emit(0x3F00 | nn % 2); break;
+			case 3: emit(0x8000 | y << 8 | 0xF0 | (next() % 4)); break;
+			case 4: emit(next() % 2 ? 0xF033 | x << 8 : 0xF055 | x << 8); break;
+			case 5: emit(0xF065 | x << 8); break;
+			default: emit(0x8000 | x << 8 | y << 4 | aluOps[next() % (sizeof(aluOps) / sizeof(aluOps[0]))]); break;
+		}
+	}
+
+	emit(0x1200);
+	return pos;
+}
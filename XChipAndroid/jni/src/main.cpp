@@ -33,19 +33,20 @@ along with this program.  If not, see http://www.gnu.org/licenses/gpl-3.0.html.
 
 static bool InitializeEmulator(xchip::Emulator* const emulator);
 
+// Cpu is 64 bytes aligned, operator new doesn't honour it in C++11
+static xchip::Emulator g_emulator;
+
 
 int main(int, char**)
 {
 	ASSERT_MSG(false, "TESTING ASSERT MSG");
 
 
-	xchip::Emulator* const emulator = new(std::nothrow) xchip::Emulator();
-	
-	if(emulator == nullptr)
-		return EXIT_FAILURE;
+	xchip::Emulator* const emulator = &g_emulator;
 
+	// SDL may call main again in the same process
 	const auto emulator_cleanup = utix::MakeScopeExit([emulator]() noexcept {
-		delete emulator;
+		emulator->Dispose();
 	});
 
 